@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// a config script of literal command calls, executed directly compared to eval.
+
+#define USE_TCL_STUBS
+#include <tcl.h>
+
+#include <metal/tcl/direct.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+Tcl_WideInt total = 0;
+
+template<typename Func>
+double measure(long iterations, Func func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    func();
+  const std::chrono::duration<double, std::micro> dur = std::chrono::steady_clock::now() - start;
+  return dur.count() / iterations;
+}
+
+}
+
+int bench_main(Tcl_Interp * interp, int argc, char * argv[])
+{
+  if (Tcl_InitStubs(interp, TCL_VERSION, 0) == nullptr)
+    return EXIT_FAILURE;
+
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 1000;
+
+  tcl::create_command(interp, "set-value").add_function(+[](Tcl_WideInt i) {total += i;});
+  tcl::create_command(interp, "set-name").add_function(+[](boost::core::string_view s) {total += s.size();});
+
+  std::string script;
+  for (int i = 0; i < 1000; i++)
+    script += "set-value " + std::to_string(i) + "\nset-name {option " + std::to_string(i) + "}\n";
+
+  tcl::direct_script ds{interp, script};
+  if (!ds.direct())
+    return EXIT_FAILURE;
+
+  // the script cache of eval keeps the bytecode, so this compares against compiled execution.
+  printf("%-14s %10.1f us/script\n", "direct_script", measure(iterations, [&]{ds.evaluate<void>().value();}));
+  printf("%-14s %10.1f us/script\n", "eval",          measure(iterations, [&]{tcl::eval(interp, script).value();}));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+// Copyright (c) 2022 Klemens D. Morgenstern
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// creates the interpreter without stubs, so the benchmarks can use the stub-only TclOO API.
+
+#include <tcl.h>
+#include <cstdio>
+#include <cstdlib>
+
+int bench_main(Tcl_Interp * interp, int argc, char** argv);
+
+int main(int argc, char** argv)
+{
+  Tcl_FindExecutable(argv[0]);
+  auto interp = Tcl_CreateInterp();
+  if (Tcl_Init(interp) != TCL_OK)
+  {
+    fprintf (stderr ,"Tcl_Init error: %s\n" ,Tcl_GetStringResult (interp));
+    exit(EXIT_FAILURE);
+  }
+  auto res = bench_main(interp, argc, argv);
+  Tcl_DeleteInterp(interp);
+  Tcl_Finalize();
+  return res;
+}
@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2022 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// throughput of static methods on bound classes, compared to a plain command.
+
+#define USE_TCL_STUBS
+#include <tcl.h>
+#define USE_TCLOO_STUBS
+#include <tclOO.h>
+
+#include <metal/tcl.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+struct counter
+{
+  static Tcl_WideInt value;
+  static Tcl_WideInt get() { return value; }
+  static void add(Tcl_WideInt n) { value += n; }
+  static void add(double n) { value += static_cast<Tcl_WideInt>(n); }
+};
+
+Tcl_WideInt counter::value = 0;
+
+BOOST_DESCRIBE_STRUCT(counter, (), (get, (void(Tcl_WideInt)) add, (void(double)) add));
+METAL_TCL_SET_CLASS_NAME(counter, counter);
+
+Tcl_WideInt add_free(Tcl_WideInt n)
+{
+  return counter::value += n;
+}
+
+namespace tcl = metal::tcl;
+
+double run(Tcl_Interp * interp, const std::string & call, long iterations)
+{
+  // byte-compiled loop, so the time is dominated by the command dispatch
+  const auto script = "for {set i 0} {$i < " + std::to_string(iterations) + "} {incr i} {" + call + "}";
+  tcl::object_ptr body = Tcl_NewStringObj(script.c_str(), script.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  if (Tcl_EvalObjEx(interp, body.get(), 0) != TCL_OK)
+  {
+    fprintf(stderr, "%s failed: %s\n", call.c_str(), Tcl_GetStringResult(interp));
+    std::exit(EXIT_FAILURE);
+  }
+  const std::chrono::duration<double, std::nano> dur = std::chrono::steady_clock::now() - start;
+  return dur.count() / iterations;
+}
+
+int bench_main(Tcl_Interp * interp, int argc, char * argv[])
+{
+  if (Tcl_InitStubs(interp, TCL_VERSION, 0) == nullptr || Tcl_OOInitStubs(interp) == nullptr)
+    return EXIT_FAILURE;
+
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+  tcl::register_class<counter>(interp);
+  tcl::create_command(interp, "add_free").add_function(&add_free);
+
+  printf("%-28s %10.1f ns/call\n", "command add_free 1",     run(interp, "add_free 1", iterations));
+  printf("%-28s %10.1f ns/call\n", "static counter add 1",   run(interp, "counter add 1", iterations));
+  printf("%-28s %10.1f ns/call\n", "static counter add 1.5", run(interp, "counter add 1.5", iterations));
+  printf("%-28s %10.1f ns/call\n", "static counter get",     run(interp, "counter get", iterations));
+  return EXIT_SUCCESS;
+}
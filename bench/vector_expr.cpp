@@ -0,0 +1,65 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// evaluating an expression over columns, natively compared to a compiled expr per row.
+
+#define USE_TCL_STUBS
+#include <tcl.h>
+
+#include <metal/tcl/vector_expr.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace tcl = metal::tcl;
+
+template<typename Func>
+double measure(std::size_t rows, Func func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  const std::chrono::duration<double, std::nano> dur = std::chrono::steady_clock::now() - start;
+  return dur.count() / rows;
+}
+
+int bench_main(Tcl_Interp * interp, int argc, char * argv[])
+{
+  if (Tcl_InitStubs(interp, TCL_VERSION, 0) == nullptr)
+    return EXIT_FAILURE;
+
+  const std::size_t rows = argc > 1 ? std::atol(argv[1]) : 1000000;
+  constexpr auto expression = "$a * $b > 100 ? sqrt($a) * 0.9 : $a + $b / 2";
+
+  std::vector<double> a(rows), b(rows), out(rows);
+  for (std::size_t i = 0u; i < rows; i++)
+  {
+    a[i] = static_cast<double>(i % 1000);
+    b[i] = static_cast<double>(i % 7) * 0.25;
+  }
+
+  tcl::vector_expr vex{interp, expression, {"a", "b"}};
+  if (!vex.native())
+    return EXIT_FAILURE;
+
+  tcl::compiled_expr cex{interp, expression};
+  const auto ia = cex.declare("a"), ib = cex.declare("b");
+
+  printf("%-16s %10.2f ns/row\n", "vector_expr", measure(rows, [&]{vex.evaluate({a, b}, out).value();}));
+  printf("%-16s %10.2f ns/row\n", "compiled_expr", measure(rows,
+         [&]
+         {
+           for (std::size_t i = 0u; i < rows; i++)
+           {
+             cex.set(ia, a[i]);
+             cex.set(ib, b[i]);
+             out[i] = cex.evaluate<double>().value();
+           }
+         }));
+  return EXIT_SUCCESS;
+}
@@ -122,43 +122,39 @@ void handle_session(asio::local::stream_protocol::socket sock)
   BOOST_SCOPE_EXIT_ALL(&) { Tcl_UnregisterChannel(p.get(), cn);};
   tcl::eval<void>(p.get(), R"(coroutine _eval_line apply {{} { while {true} {eval [ yield ]} }} )").value();
 
-  std::string buf;
-  auto dbuf = asio::dynamic_buffer(buf);
+  tcl::command_stream cs{p};
 
   asio::write(sock, asio::buffer("shell> "));
 
   while (true)
   {
-    auto n = sock.read_some(dbuf.prepare(4096));
-    dbuf.commit(n);
-    tcl::parse_result pr;
-    std::string_view cmd{buf.data(), n};
-    auto pre = cmd.find_first_not_of(" \n\r\t");
-    if (pre == std::string_view::npos)
-    {
-      dbuf.consume(cmd.size());
-      asio::write(sock, asio::buffer("shell> "));
-      continue;
-    }
+    auto buf = cs.prepare(4096);
+    cs.commit(sock.read_some(asio::buffer(buf.data(), buf.size())));
 
-    auto pc = tcl::parse_command(p, pr, cmd, true);
-
-    if (!pc && pr.incomplete)
+    bool evaluated = false;
+    while (true)
     {
-      std::string resp = tcl::cast<std::string>(p, pc.error());
+      auto nx = cs.next();
+      if (nx.has_error())
+      {
+        std::string resp = tcl::cast<std::string>(p, nx.error());
+        resp += "\nshell> ";
+        asio::write(sock, asio::buffer(resp));
+        continue;
+      }
+      if (!*nx)
+        break;
+
+      auto res = tcl::eval(p, **nx);
+      std::string resp = tcl::cast<std::string>(p, res ? res.value() : res.error());
       resp += "\nshell> ";
-      std::cout << pr.command() << std::endl;
       asio::write(sock, asio::buffer(resp));
-      continue;
+      evaluated = true;
     }
-    if (pr.incomplete)
-      continue ;
-
-    auto res = tcl::eval(p, pr.command());
-    dbuf.consume(pr.command().size());
-    std::string resp = tcl::cast<std::string>(p, res ? res.value() : res.error());
-    resp += "\nshell> ";
-    asio::write(sock, asio::buffer(resp));
+
+    // empty lines just get a new prompt
+    if (!evaluated && cs.pending().find_first_not_of(" \n\r\t") == boost::core::string_view::npos)
+      asio::write(sock, asio::buffer("shell> "));
   }
 }
 
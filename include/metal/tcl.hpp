@@ -9,23 +9,36 @@
 #define METAL_TCL_H
 
 #include <metal/tcl/allocator.hpp>
+#include <metal/tcl/asio_notifier.hpp>
 #include <metal/tcl/async.hpp>
+#include <metal/tcl/ast.hpp>
+#include <metal/tcl/async_eval.hpp>
 #include <metal/tcl/builtin.hpp>
 #include <metal/tcl/cast.hpp>
 #include <metal/tcl/channel.hpp>
 #include <metal/tcl/class.hpp>
 #include <metal/tcl/command.hpp>
+#include <metal/tcl/direct.hpp>
 #include <metal/tcl/enum.hpp>
 #include <metal/tcl/eval.hpp>
 #include <metal/tcl/event.hpp>
 #include <metal/tcl/exception.hpp>
 #include <metal/tcl/expr.hpp>
+#include <metal/tcl/fcopy.hpp>
 #include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/limit.hpp>
+#include <metal/tcl/link.hpp>
+#include <metal/tcl/nr.hpp>
 #include <metal/tcl/object.hpp>
 #include <metal/tcl/package.hpp>
 #include <metal/tcl/parse.hpp>
+#include <metal/tcl/prepared_script.hpp>
+#include <metal/tcl/shared.hpp>
+#include <metal/tcl/socket_channel.hpp>
 #include <metal/tcl/string_command.hpp>
 #include <metal/tcl/thread.hpp>
+#include <metal/tcl/transform.hpp>
 #include <metal/tcl/var.hpp>
+#include <metal/tcl/vector_expr.hpp>
 
 #endif //METAL_TCL_H
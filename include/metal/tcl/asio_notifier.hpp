@@ -0,0 +1,346 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_ASIO_NOTIFIER_HPP
+#define METAL_TCL_ASIO_NOTIFIER_HPP
+
+#include <tcl.h>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/throw_exception.hpp>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+// file handlers are only a thing on unix, windows uses a different notifier interface.
+#if !defined(_WIN32)
+
+#include <unistd.h>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// the notifier of one thread
+struct asio_notifier_state : std::enable_shared_from_this<asio_notifier_state>
+{
+  struct file_handler
+  {
+    file_handler(boost::asio::io_context & ctx, int fd) : fd(fd), descriptor(ctx, ::dup(fd)) {}
+
+    const int fd;
+    // a duplicate, so an asio object in the same io_context can own the original.
+    boost::asio::posix::stream_descriptor descriptor;
+    Tcl_FileProc * proc = nullptr;
+    ClientData data = nullptr;
+    int mask = 0;
+    int ready = 0;
+    int pending = 0;
+    bool queued = false;
+    bool deleted = false;
+  };
+
+  struct file_event : Tcl_Event
+  {
+    int fd;
+  };
+
+  explicit asio_notifier_state(boost::asio::io_context * ctx)
+      : owned_(ctx == nullptr ? std::make_unique<boost::asio::io_context>(1) : nullptr),
+        ctx_(ctx == nullptr ? *owned_ : *ctx), timer_(ctx_)
+  {
+  }
+
+  ~asio_notifier_state()
+  {
+    boost::system::error_code ec;
+    for (auto & [fd, fh] : files_)
+    {
+      fh->deleted = true;
+      fh->descriptor.close(ec);
+    }
+    files_.clear();
+    timer_.cancel();
+  }
+
+  static std::shared_ptr<asio_notifier_state> & current()
+  {
+    thread_local std::shared_ptr<asio_notifier_state> st;
+    return st;
+  }
+
+  static boost::asio::io_context * & bound_context()
+  {
+    thread_local boost::asio::io_context * ctx = nullptr;
+    return ctx;
+  }
+
+  // the states that can be alerted from other threads
+  static std::mutex & registry_mutex()
+  {
+    static std::mutex mtx;
+    return mtx;
+  }
+  static std::unordered_set<asio_notifier_state*> & registry()
+  {
+    static std::unordered_set<asio_notifier_state*> reg;
+    return reg;
+  }
+
+  static ClientData init()
+  {
+    auto & st = current();
+    st = std::make_shared<asio_notifier_state>(bound_context());
+    std::lock_guard<std::mutex> lock{registry_mutex()};
+    registry().insert(st.get());
+    return st.get();
+  }
+
+  static void finalize(ClientData data)
+  {
+    auto & st = current();
+    if (st.get() != data)
+      return;
+    {
+      std::lock_guard<std::mutex> lock{registry_mutex()};
+      registry().erase(st.get());
+    }
+    st.reset();
+  }
+
+  static void alert(ClientData data)
+  {
+    std::lock_guard<std::mutex> lock{registry_mutex()};
+    if (registry().count(static_cast<asio_notifier_state*>(data)) == 0)
+      return;
+    auto & this_ = *static_cast<asio_notifier_state*>(data);
+    // any completion makes wait return
+    boost::asio::post(this_.ctx_,
+                      [w = this_.weak_from_this()]
+                      {
+                        if (!w.expired())
+                          Tcl_ServiceAll();
+                      });
+  }
+
+  // only used when asio drives tcl, i.e. the service mode is TCL_SERVICE_ALL.
+  static void set_timer(const Tcl_Time * time)
+  {
+    auto st = current();
+    if (!st)
+      return;
+    if (time == nullptr)
+    {
+      st->timer_.cancel();
+      return;
+    }
+    st->timer_.expires_after(std::chrono::seconds(time->sec) + std::chrono::microseconds(time->usec));
+    st->timer_.async_wait(
+        [w = st->weak_from_this()](boost::system::error_code ec)
+        {
+          if (!ec && !w.expired())
+            Tcl_ServiceAll();
+        });
+  }
+
+  static int wait(const Tcl_Time * time)
+  {
+    auto st = current();
+    if (!st)
+      return -1;
+    auto & ctx = st->ctx_;
+    if (ctx.stopped())
+      ctx.restart();
+
+    // so run_one doesn't return right away if there's nothing else to do
+    auto guard = boost::asio::make_work_guard(ctx);
+    std::size_t n = 0u;
+    if (time == nullptr)
+      n = ctx.run_one();
+    else if (time->sec == 0 && time->usec == 0)
+      n = ctx.poll();
+    else
+      n = ctx.run_one_for(std::chrono::seconds(time->sec) + std::chrono::microseconds(time->usec));
+    // everything else that's ready
+    if (n > 0u && !ctx.stopped())
+      n += ctx.poll();
+
+    // releasing the last work stops the context, which would make the next run return right away.
+    guard.reset();
+    if (ctx.stopped())
+      ctx.restart();
+    return n > 0u ? 1 : 0;
+  }
+
+  static void create_file_handler(int fd, int mask, Tcl_FileProc * proc, ClientData data)
+  {
+    auto st = current();
+    if (!st)
+      return;
+    auto & fh = st->files_[fd];
+    if (!fh)
+      fh = std::make_shared<file_handler>(st->ctx_, fd);
+    fh->proc = proc;
+    fh->data = data;
+    fh->mask = mask;
+    st->arm_(fh);
+  }
+
+  static void delete_file_handler(int fd)
+  {
+    auto st = current();
+    if (!st)
+      return;
+    auto itr = st->files_.find(fd);
+    if (itr == st->files_.end())
+      return;
+    boost::system::error_code ec;
+    itr->second->deleted = true;
+    itr->second->descriptor.close(ec);
+    st->files_.erase(itr);
+  }
+
+  static void service_mode_hook(int) {}
+
+  boost::asio::io_context & context() {return ctx_;}
+
+ private:
+  void arm_(const std::shared_ptr<file_handler> & fh)
+  {
+    using wait_type = boost::asio::posix::descriptor_base::wait_type;
+    constexpr std::pair<int, wait_type> waits[] = {
+        {TCL_READABLE,  wait_type::wait_read},
+        {TCL_WRITABLE,  wait_type::wait_write},
+        {TCL_EXCEPTION, wait_type::wait_error}};
+
+    for (auto [bit, type] : waits)
+    {
+      if ((fh->mask & bit) == 0 || (fh->pending & bit) != 0)
+        continue;
+      fh->pending |= bit;
+      fh->descriptor.async_wait(
+          type,
+          [fh, bit = bit, w = weak_from_this()](boost::system::error_code ec)
+          {
+            fh->pending &= ~bit;
+            auto st = w.lock();
+            if (ec == boost::asio::error::operation_aborted || fh->deleted || !st)
+              return;
+            // errors, e.g. epoll not supporting regular files, make it ready, like select would.
+            fh->ready |= bit;
+            st->queue_(*fh);
+            Tcl_ServiceAll();
+          });
+    }
+  }
+
+  void queue_(file_handler & fh)
+  {
+    if (fh.queued)
+      return;
+    fh.queued = true;
+    auto ev = reinterpret_cast<file_event*>(Tcl_Alloc(sizeof(file_event)));
+    ev->proc = &file_event_proc_;
+    ev->fd = fh.fd;
+    Tcl_QueueEvent(ev, TCL_QUEUE_TAIL);
+  }
+
+  static int file_event_proc_(Tcl_Event * ev, int flags)
+  {
+    if ((flags & TCL_FILE_EVENTS) == 0)
+      return 0;
+    auto st = current();
+    if (!st)
+      return 1;
+    auto itr = st->files_.find(static_cast<file_event*>(ev)->fd);
+    if (itr == st->files_.end())
+      return 1;
+
+    auto fh = itr->second;
+    fh->queued = false;
+    const int mask = fh->ready & fh->mask;
+    fh->ready = 0;
+    if (mask != 0)
+      fh->proc(fh->data, mask);
+    // the proc might have removed or replaced the handler
+    if (!fh->deleted)
+      st->arm_(fh);
+    return 1;
+  }
+
+  std::unique_ptr<boost::asio::io_context> owned_;
+  boost::asio::io_context & ctx_;
+  boost::asio::steady_timer timer_;
+  std::unordered_map<int, std::shared_ptr<file_handler>> files_;
+};
+
+}
+
+/** Replace tcl's notifier with one built on asio, for the whole process.
+ *
+ * This must be called before any other tcl function, i.e. before `Tcl_FindExecutable`.
+ *
+ * Every thread that uses tcl gets its notifier's io_context on first use: the one passed to `use_io_context`
+ * or an internal one. File handlers, timers & `Tcl_ThreadAlert` become asio operations,
+ * so the event loop can go either way:
+ *
+ *  - `vwait`, `update` & `Tcl_DoOneEvent` run the io_context & thus complete asio operations too.
+ *  - Running the io_context services tcl events, if `Tcl_SetServiceMode(TCL_SERVICE_ALL)` was called.
+ *
+ * The io_context should only be run by the thread it belongs to.
+ */
+inline void set_asio_notifier()
+{
+  using st = detail::asio_notifier_state;
+  Tcl_NotifierProcs procs{
+    /*.setTimerProc=*/           &st::set_timer,
+    /*.waitForEventProc=*/       &st::wait,
+    /*.createFileHandlerProc=*/  &st::create_file_handler,
+    /*.deleteFileHandlerProc=*/  &st::delete_file_handler,
+    /*.initNotifierProc=*/       &st::init,
+    /*.finalizeNotifierProc=*/   &st::finalize,
+    /*.alertNotifierProc=*/      &st::alert,
+    /*.serviceModeHookProc=*/    &st::service_mode_hook
+  };
+  Tcl_SetNotifier(&procs);
+}
+
+/** Use ctx as the io_context of the current thread's notifier.
+ *
+ * This must be called before the thread uses tcl, since the notifier gets initialized with the first use.
+ */
+inline void use_io_context(boost::asio::io_context & ctx)
+{
+  if (detail::asio_notifier_state::current())
+    BOOST_THROW_EXCEPTION(std::logic_error("the notifier of this thread is already initialized"));
+  detail::asio_notifier_state::bound_context() = &ctx;
+}
+
+/// The io_context of the current thread's notifier. Throws if `set_asio_notifier` wasn't used or tcl isn't initialized yet.
+inline boost::asio::io_context & get_io_context()
+{
+  auto & st = detail::asio_notifier_state::current();
+  if (!st)
+    BOOST_THROW_EXCEPTION(std::logic_error("the asio notifier isn't active in this thread"));
+  return st->context();
+}
+
+}
+
+#endif
+
+#endif //METAL_TCL_ASIO_NOTIFIER_HPP
@@ -0,0 +1,287 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_AST_HPP
+#define METAL_TCL_AST_HPP
+
+#include <tcl.h>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+#include <metal/tcl/parse.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+#include <boost/core/span.hpp>
+#include <boost/system/result.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+struct ast_builder;
+}
+
+/** The syntax tree of a whole script.
+ *
+ * All nodes & a copy of the source live in a monotonic arena, so the tree gets built in one pass over the source
+ * and freed at once. The text of every node is a view into the retained source.
+ *
+ * The tree looks like this:
+ *
+ *  - `script`: `command` & `comment` nodes
+ *  - `command`: `word`, `simple_word` & `expand_word` nodes
+ *  - words: `text`, `backslash`, `command_subst`, `variable` & `braced` nodes
+ *  - `command_subst`: the commands inside the brackets
+ *  - `variable`: the name as `text`, followed by the components of the index
+ *  - `braced`: a braced word that parsed as a script, with its commands
+ *
+ * Whether a braced word is code depends on the command using it, so every braced word that is a valid script
+ * gets its tree, e.g. the list in `set x {a b}` too. Words that aren't valid scripts stay `text`.
+ */
+struct ast
+{
+  enum class node_kind : std::uint8_t
+  {
+    script, command, comment,
+    word, simple_word, expand_word,
+    text, backslash, command_subst, variable, braced
+  };
+
+  struct node
+  {
+    node_kind kind;
+    boost::core::string_view text;
+
+    boost::span<const node> children() const {return {children_, size_};}
+    // children_ & size_ are set by the builder
+    const node * children_ = nullptr;
+    std::uint32_t size_ = 0u;
+  };
+
+  static_assert(std::is_trivially_destructible_v<node>);
+
+  /// Parse a whole script. If `braces` is false, braced words are kept as text.
+  static result<ast> parse(Tcl_Interp * interp, boost::core::string_view source, bool braces = true);
+  static result<ast> parse(const interpreter_ptr & interp, boost::core::string_view source, bool braces = true)
+  {
+    return parse(interp.get(), source, braces);
+  }
+
+  const node & root() const {return *root_;}
+  boost::core::string_view source() const {return source_;}
+  /// Number of nodes in the tree.
+  std::size_t size() const {return size_;}
+
+  /// Invoke `func(const node &, std::size_t depth)` on every node, depth first.
+  template<typename Func>
+  void visit(Func && func) const
+  {
+    visit_(*root_, func, 0u);
+  }
+
+ private:
+  friend struct detail::ast_builder;
+  ast() : arena_(std::make_unique<std::pmr::monotonic_buffer_resource>()) {}
+
+  template<typename Func>
+  static void visit_(const node & nd, Func & func, std::size_t depth)
+  {
+    func(nd, depth);
+    for (const auto & c : nd.children())
+      visit_(c, func, depth + 1);
+  }
+
+  // a pointer, so moving the tree doesn't invalidate it
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+  boost::core::string_view source_;
+  const node * root_ = nullptr;
+  std::size_t size_ = 0u;
+};
+
+namespace detail
+{
+
+struct ast_builder
+{
+  using node = ast::node;
+  using node_kind = ast::node_kind;
+
+  ast & tree;
+  Tcl_Interp * interp;
+  bool braces;
+
+  // the children are collected here & then copied into the arena, so nodes are trivially copyable.
+  const node * commit(const std::vector<node> & nodes, std::size_t first, node & parent)
+  {
+    const auto n = nodes.size() - first;
+    auto p = static_cast<node*>(tree.arena_->allocate(sizeof(node) * n, alignof(node)));
+    std::uninitialized_copy(nodes.begin() + first, nodes.end(), p);
+    parent.children_ = p;
+    parent.size_ = static_cast<std::uint32_t>(n);
+    tree.size_ += n;
+    return p;
+  }
+
+  // parses the commands of src into the children of parent. errors are only reported if report is set
+  bool script(boost::core::string_view src, node & parent, std::vector<node> & stack, bool report)
+  {
+    const std::size_t first = stack.size();
+    // nodes committed by a script that fails to parse get dropped, so they must not be counted either.
+    const std::size_t size = tree.size_;
+    parse_result pr;
+    const char * p = src.data();
+    const char * end = src.data() + src.size();
+
+    while (p < end)
+    {
+      Tcl_FreeParse(&pr);
+      // nothing half-parsed may stay on the stack, e.g. when a braced word falls back to text
+      if (Tcl_ParseCommand(report ? interp : nullptr, p, static_cast<int>(end - p), 0, &pr) != TCL_OK)
+      {
+        stack.resize(first);
+        tree.size_ = size;
+        return false;
+      }
+
+      if (pr.commentSize > 0)
+        stack.push_back(node{node_kind::comment, pr.comment()});
+
+      if (pr.numWords > 0)
+      {
+        auto cmd = pr.command();
+        // without the terminating newline or semicolon
+        cmd = cmd.substr(0u, cmd.find_last_not_of(" \t\r\n;") + 1u);
+        stack.push_back(node{node_kind::command, cmd});
+        node cmd_node = stack.back();
+        stack.pop_back();
+
+        const auto sub = stack.size();
+        auto tokens = pr.tokens();
+        for (std::size_t i = 0u; i < tokens.size(); i += 1u + tokens[i].numComponents)
+          if (!word(tokens.subspan(i, 1u + tokens[i].numComponents), stack, report))
+          {
+            stack.resize(first);
+            tree.size_ = size;
+            return false;
+          }
+        commit(stack, sub, cmd_node);
+        stack.resize(sub);
+        stack.push_back(cmd_node);
+      }
+
+      const char * next = pr.commandStart + pr.commandSize;
+      if (next <= p)
+        break;
+      p = next;
+    }
+
+    commit(stack, first, parent);
+    stack.resize(first);
+    return true;
+  }
+
+  bool word(boost::span<Tcl_Token> tokens, std::vector<node> & stack, bool report)
+  {
+    const auto & tk = tokens[0];
+    node nd{tk.type == TCL_TOKEN_SIMPLE_WORD ? node_kind::simple_word :
+            tk.type == TCL_TOKEN_EXPAND_WORD ? node_kind::expand_word : node_kind::word,
+            {tk.start, static_cast<std::size_t>(tk.size)}};
+
+    const auto sub = stack.size();
+    if (!components(tokens.subspan(1u), stack, report,
+                     tk.type == TCL_TOKEN_SIMPLE_WORD && braces && tk.start[0] == '{'))
+      return false;
+    commit(stack, sub, nd);
+    stack.resize(sub);
+    stack.push_back(nd);
+    return true;
+  }
+
+  bool components(boost::span<Tcl_Token> tokens, std::vector<node> & stack, bool report, bool braced = false)
+  {
+    for (std::size_t i = 0u; i < tokens.size(); i += 1u + tokens[i].numComponents)
+    {
+      const auto & tk = tokens[i];
+      node nd{node_kind::text, {tk.start, static_cast<std::size_t>(tk.size)}};
+      switch (tk.type)
+      {
+        case TCL_TOKEN_TEXT:
+          // the content of a braced word is only a script if it parses as one
+          if (braced && script(nd.text, nd, stack, false))
+            nd.kind = node_kind::braced;
+          break;
+        case TCL_TOKEN_BS:
+          nd.kind = node_kind::backslash;
+          break;
+        case TCL_TOKEN_COMMAND:
+          nd.kind = node_kind::command_subst;
+          if (!script(nd.text.substr(1u, nd.text.size() - 2u), nd, stack, report))
+            return false;
+          break;
+        case TCL_TOKEN_VARIABLE:
+        {
+          nd.kind = node_kind::variable;
+          const auto sub = stack.size();
+          if (!components(tokens.subspan(i + 1u, tk.numComponents), stack, report))
+            return false;
+          commit(stack, sub, nd);
+          stack.resize(sub);
+          break;
+        }
+        default:
+          break;
+      }
+      stack.push_back(nd);
+    }
+    return true;
+  }
+};
+
+}
+
+inline result<ast> ast::parse(Tcl_Interp * interp, boost::core::string_view source, bool braces)
+{
+  ast tree;
+  auto buf = static_cast<char*>(tree.arena_->allocate(source.size() + 1u, 1u));
+  std::copy(source.begin(), source.end(), buf);
+  buf[source.size()] = '\0';
+  tree.source_ = boost::core::string_view{buf, source.size()};
+
+  auto root = static_cast<node*>(tree.arena_->allocate(sizeof(node), alignof(node)));
+  new (root) node{node_kind::script, tree.source_};
+  tree.root_ = root;
+  tree.size_ = 1u;
+
+  detail::ast_builder builder{tree, interp, braces};
+  std::vector<node> stack;
+  if (!builder.script(tree.source_, *root, stack, true))
+    return result<ast>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
+
+  return result<ast>{boost::system::in_place_value, std::move(tree)};
+}
+
+inline result<ast> parse_ast(Tcl_Interp * interp, boost::core::string_view source, bool braces = true)
+{
+  return ast::parse(interp, source, braces);
+}
+
+inline result<ast> parse_ast(const interpreter_ptr & interp, boost::core::string_view source, bool braces = true)
+{
+  return ast::parse(interp.get(), source, braces);
+}
+
+}
+
+#endif //METAL_TCL_AST_HPP
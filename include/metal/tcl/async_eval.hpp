@@ -0,0 +1,396 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_ASYNC_EVAL_HPP
+#define METAL_TCL_ASYNC_EVAL_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/event.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+#include <metal/tcl/thread.hpp>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/system/result.hpp>
+
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// the result of an eval, without any tcl objects, so it can be passed to another thread.
+// The objects of result<T> get created by `take` on the thread that consumes it.
+template<typename T>
+struct detached_result
+{
+  using value_type = std::conditional_t<std::is_void_v<T>, bool,
+                     std::conditional_t<std::is_same_v<T, object_ptr>, std::string, T>>;
+
+  std::optional<value_type> value;
+  // the error message, if it's not a C++ exception
+  std::string error;
+  std::exception_ptr exception;
+
+  result<T> take() &&
+  {
+    if (exception)
+      return result<T>{boost::system::in_place_error, make_exception_object(exception)};
+    if (!value)
+      return result<T>{boost::system::in_place_error,
+                       Tcl_NewStringObj(error.data(), static_cast<int>(error.size()))};
+
+    if constexpr (std::is_void_v<T>)
+      return result<void>{boost::system::in_place_value};
+    else if constexpr (std::is_same_v<T, object_ptr>)
+      return result<T>{boost::system::in_place_value,
+                       Tcl_NewStringObj(value->data(), static_cast<int>(value->size()))};
+    else
+      return result<T>{boost::system::in_place_value, std::move(*value)};
+  }
+};
+
+inline std::string detach_string(Tcl_Obj * obj)
+{
+  int len = 0;
+  const char * str = Tcl_GetStringFromObj(obj, &len);
+  return std::string(str, static_cast<std::size_t>(len));
+}
+
+template<typename T>
+detached_result<T> detach_result(Tcl_Interp * interp, int code)
+{
+  detached_result<T> res;
+  Tcl_Obj * obj = Tcl_GetObjResult(interp);
+  if (code != TCL_OK)
+  {
+    if (obj->typePtr == &exception_ptr_type)
+      res.exception = *reinterpret_cast<std::exception_ptr*>(&obj->internalRep.twoPtrValue.ptr1);
+    else
+      res.error = detach_string(obj);
+    return res;
+  }
+
+  try
+  {
+    if constexpr (std::is_void_v<T>)
+      res.value.emplace(true);
+    else if constexpr (std::is_same_v<T, object_ptr>)
+      res.value.emplace(detach_string(obj));
+    else
+      res.value.emplace(cast<T>(interp, obj));
+  }
+  catch (...)
+  {
+    res.exception = std::current_exception();
+  }
+  return res;
+}
+
+struct eval_job
+{
+  std::string script;
+
+  explicit eval_job(std::string script) : script(std::move(script)) {}
+  virtual ~eval_job() = default;
+  // called on the interpreter's thread, interp is null if it got deleted.
+  // If the thread exited, it gets called by whichever thread submits or finalizes it.
+  virtual void complete(Tcl_Interp * interp, int code) = 0;
+};
+
+// Handler gets a detached_result<T>
+template<typename T, typename Handler>
+struct eval_job_impl final : eval_job
+{
+  Handler handler;
+
+  eval_job_impl(std::string script, Handler && handler) : eval_job(std::move(script)), handler(std::move(handler)) {}
+
+  void complete(Tcl_Interp * interp, int code) override
+  {
+    if (interp == nullptr)
+    {
+      detached_result<T> res;
+      res.error = "interpreter deleted";
+      handler(std::move(res));
+    }
+    else
+      handler(detach_result<T>(interp, code));
+  }
+};
+
+// the jobs submitted to an interpreter. All jobs submitted before the interpreter's thread
+// gets to them are run by a single event.
+struct eval_queue
+{
+  Tcl_Interp * interp;
+  thread::id owner;
+
+  std::mutex mtx;
+  std::vector<std::unique_ptr<eval_job>> pending;
+  bool scheduled = false;
+  bool thread_exited = false;
+  // keeps the queue alive while an event is queued, since the event must be trivially destructible.
+  std::shared_ptr<eval_queue> self_ref;
+
+  eval_queue(Tcl_Interp * interp) : interp(interp), owner(Tcl_GetCurrentThread()) {}
+
+  void submit(const std::shared_ptr<eval_queue> & self, std::unique_ptr<eval_job> job)
+  {
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      if (!thread_exited)
+      {
+        pending.push_back(std::move(job));
+        if (scheduled)
+          return;
+        scheduled = true;
+        self_ref = self;
+      }
+    }
+
+    // nobody would ever run it
+    if (job)
+    {
+      job->complete(nullptr, TCL_ERROR);
+      return;
+    }
+
+    Tcl_ThreadQueueEvent(owner,
+                         new event(
+                             [q = this](int)
+                             {
+                               q->run();
+                               return true;
+                             }),
+                         TCL_QUEUE_TAIL);
+    Tcl_ThreadAlert(owner);
+  }
+
+  // runs on the owning thread
+  void run()
+  {
+    std::vector<std::unique_ptr<eval_job>> jobs;
+    std::shared_ptr<eval_queue> self;
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      jobs.swap(pending);
+      scheduled = false;
+      self = std::move(self_ref);
+    }
+
+    for (auto & job : jobs)
+    {
+      if (interp == nullptr)
+      {
+        job->complete(nullptr, TCL_ERROR);
+        continue;
+      }
+
+      Tcl_Preserve(interp);
+      const int code = eval_cached(interp, job->script, 0);
+      job->complete(interp, code);
+      Tcl_ResetResult(interp);
+      Tcl_Release(interp);
+    }
+  }
+
+  void close()
+  {
+    std::vector<std::unique_ptr<eval_job>> jobs;
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      interp = nullptr;
+      jobs.swap(pending);
+    }
+    for (auto & job : jobs)
+      job->complete(nullptr, TCL_ERROR);
+  }
+
+  // the owning thread gets finalized, which frees a queued event without running it.
+  void abandon()
+  {
+    std::shared_ptr<eval_queue> self;
+    {
+      std::lock_guard<std::mutex> lock{mtx};
+      thread_exited = true;
+      scheduled = false;
+      self = std::move(self_ref);
+    }
+    close();
+  }
+};
+
+inline std::shared_ptr<eval_queue> get_eval_queue(Tcl_Interp * interp)
+{
+  constexpr char key[] = "metal::tcl::eval_queue";
+  auto p = static_cast<std::shared_ptr<eval_queue>*>(Tcl_GetAssocData(interp, key, nullptr));
+  if (p == nullptr)
+  {
+    p = new std::shared_ptr<eval_queue>(std::make_shared<eval_queue>(interp));
+    Tcl_SetAssocData(interp, key,
+                     +[](ClientData clientData, Tcl_Interp *)
+                     {
+                       std::unique_ptr<std::shared_ptr<eval_queue>> p{static_cast<std::shared_ptr<eval_queue>*>(clientData)};
+                       (*p)->close();
+                     }, p);
+
+    // it might outlive the interpreter, but not the thread
+    Tcl_CreateThreadExitHandler(
+        +[](ClientData clientData)
+        {
+          std::unique_ptr<std::weak_ptr<eval_queue>> w{static_cast<std::weak_ptr<eval_queue>*>(clientData)};
+          if (auto q = w->lock())
+            q->abandon();
+        }, new std::weak_ptr<eval_queue>(*p));
+  }
+  return *p;
+}
+
+}
+
+/** A handle to an interpreter that can be used from any thread.
+ *
+ * It must be created on the thread that owns the interpreter. Scripts submitted through it
+ * are run by that thread's event loop, so it needs to process events, e.g. by `vwait` or `Tcl_DoOneEvent`.
+ */
+struct interpreter_handle
+{
+  explicit interpreter_handle(Tcl_Interp * interp) : queue_(detail::get_eval_queue(interp)) {}
+  explicit interpreter_handle(const interpreter_ptr & interp) : interpreter_handle(interp.get()) {}
+
+  /// The thread that owns the interpreter.
+  thread::id thread_id() const {return queue_->owner;}
+
+  /** Submit a script, the handler gets invoked with a `result<T>` on the interpreter's thread.
+   *
+   * If that thread already exited, the handler gets invoked with an error right away.
+   */
+  template<typename T = object_ptr, typename Handler>
+  void submit(std::string script, Handler && handler) const
+  {
+    submit_detached<T>(std::move(script),
+                       [handler = std::forward<Handler>(handler)](detail::detached_result<T> res) mutable
+                       {
+                         handler(std::move(res).take());
+                       });
+  }
+
+  /// Like `submit`, but the handler gets a `detail::detached_result<T>`, which can be passed to another thread.
+  template<typename T = object_ptr, typename Handler>
+  void submit_detached(std::string script, Handler && handler) const
+  {
+    queue_->submit(queue_, std::make_unique<detail::eval_job_impl<T, std::decay_t<Handler>>>(
+        std::move(script), std::forward<Handler>(handler)));
+  }
+
+ private:
+  std::shared_ptr<detail::eval_queue> queue_;
+};
+
+/** The future of an `async_eval`, like a `std::future<result<T>>`.
+ *
+ * The result crosses threads as a string or converted value, `get` creates its objects on the calling thread.
+ */
+template<typename T>
+struct eval_future
+{
+  eval_future() = default;
+  explicit eval_future(std::future<detail::detached_result<T>> future) : future_(std::move(future)) {}
+
+  bool valid() const {return future_.valid();}
+  void wait() const {future_.wait();}
+
+  template<typename Rep, typename Period>
+  std::future_status wait_for(const std::chrono::duration<Rep, Period> & timeout) const
+  {
+    return future_.wait_for(timeout);
+  }
+
+  template<typename Clock, typename Duration>
+  std::future_status wait_until(const std::chrono::time_point<Clock, Duration> & time) const
+  {
+    return future_.wait_until(time);
+  }
+
+  result<T> get() {return future_.get().take();}
+
+ private:
+  std::future<detail::detached_result<T>> future_;
+};
+
+/** Evaluate a script on the interpreter's thread.
+ *
+ * The result gets converted on the interpreter's thread. Results & errors that are objects get passed
+ * as strings & become objects without an internal representation on the thread that waits for them.
+ * C++ exceptions thrown by commands are kept as `exception_ptr_type` objects, i.e. `throw_result` or
+ * `cast<std::exception_ptr>` rethrow the original exception.
+ *
+ * If the interpreter's thread exits before it ran the script, the result is an error.
+ *
+ * @code
+ * tcl::eval_future<int> f = tcl::async_eval<int>(handle, "expr {6 * 7}");
+ * @endcode
+ */
+template<typename T = object_ptr>
+eval_future<T> async_eval(const interpreter_handle & handle, std::string script)
+{
+  std::promise<detail::detached_result<T>> promise;
+  eval_future<T> future{promise.get_future()};
+  handle.submit_detached<T>(std::move(script),
+                            [promise = std::move(promise)](detail::detached_result<T> res) mutable
+                            {
+                              promise.set_value(std::move(res));
+                            });
+  return future;
+}
+
+/// Evaluate a script on the interpreter's thread, and complete with `void(result<T>)` on the handler's executor.
+template<typename T = object_ptr, typename CompletionToken>
+auto async_eval(const interpreter_handle & handle, std::string script, CompletionToken && token)
+{
+  return boost::asio::async_initiate<CompletionToken, void(result<T>)>(
+      [](auto handler, const interpreter_handle & handle, std::string script)
+      {
+        auto work = boost::asio::make_work_guard(handler);
+        handle.submit_detached<T>(
+            std::move(script),
+            [handler = std::move(handler), work = std::move(work)](detail::detached_result<T> res) mutable
+            {
+              auto exec = work.get_executor();
+              // the objects get created on the handler's executor
+              boost::asio::post(exec,
+                                [handler = std::move(handler), res = std::move(res)]() mutable
+                                {
+                                  std::move(handler)(std::move(res).take());
+                                });
+              work.reset();
+            });
+      },
+      token, std::cref(handle), std::move(script));
+}
+
+}
+
+#endif //METAL_TCL_ASYNC_EVAL_HPP
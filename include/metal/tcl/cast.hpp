@@ -90,6 +90,40 @@ auto make_object(Tcl_Interp *interp, T && t) -> decltype(tag_invoke(convert_tag{
     return tag_invoke(convert_tag{}, interp, std::forward<T>(t));
 }
 
+namespace detail
+{
+
+// writes the value into obj, which must not be shared. Returns false if T has no matching tcl type.
+template<typename T>
+bool assign_in_place(Tcl_Obj * obj, const T & value)
+{
+  if constexpr (std::is_same_v<T, bool>)
+    Tcl_SetBooleanObj(obj, value);
+  else if constexpr (std::is_integral_v<T> && (std::is_signed_v<T> || sizeof(T) < sizeof(Tcl_WideInt)))
+    Tcl_SetWideIntObj(obj, static_cast<Tcl_WideInt>(value));
+  else if constexpr (std::is_floating_point_v<T>)
+    Tcl_SetDoubleObj(obj, static_cast<double>(value));
+  else if constexpr (std::is_convertible_v<const T&, boost::core::string_view>)
+  {
+    const boost::core::string_view sv = value;
+    Tcl_SetStringObj(obj, sv.data(), static_cast<int>(sv.size()));
+  }
+  else
+    return false;
+  return true;
+}
+
+// assigns a value to obj, reusing the object if nobody else holds a reference to it.
+template<typename T>
+void assign(Tcl_Interp * interp, object_ptr & obj, const T & value)
+{
+  if (obj && !Tcl_IsShared(obj.get()) && assign_in_place(obj.get(), value))
+    return;
+  obj = make_object(interp, value);
+}
+
+}
+
 template<typename T>
 struct cast_tag {};
 
@@ -10,6 +10,21 @@
 
 #include <tcl.h>
 #include <metal/tcl/class.hpp>
+#include <metal/tcl/detail/mapped_file.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/core/span.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace metal::tcl
 {
@@ -23,9 +38,10 @@ Tcl_DriverGetHandleProc * getHandleProcImpl(rank<0>) { return nullptr;}
 template<typename Impl, typename = decltype(&Impl::get_handle)>
 Tcl_DriverGetHandleProc  * getHandleProcImpl(rank<1>)
 {
-  return +[](ClientData instanceData, int direction, ClientData *handlePtr)
+  return +[](ClientData instanceData, int direction, ClientData *handlePtr) -> int
           {
             *handlePtr = static_cast<Impl*>(instanceData)->get_handle(direction);
+            return TCL_OK;
           };
 }
 
@@ -77,9 +93,9 @@ const Tcl_ChannelType channel_type{
       {
         return static_cast<Impl*>(instanceData)->output(buf, toWrite, *errorCodePtr);
       },
-  /*.seekProc=*/+[](ClientData instanceData, long offset, int mode, int *errorCodePtr)
+  /*.seekProc=*/+[](ClientData instanceData, long offset, int mode, int *errorCodePtr) -> int
       {
-        return static_cast<Impl*>(instanceData)->seek(offset, mode, *errorCodePtr);
+        return static_cast<int>(static_cast<Impl*>(instanceData)->seek(offset, mode, *errorCodePtr));
       },
   /*.setOptionProc=*/+[](ClientData instanceData, Tcl_Interp *interp, const char *optionName, const char *value)
       {
@@ -117,12 +133,550 @@ const Tcl_ChannelType channel_type{
 
 }
 
+namespace detail
+{
+
+template<typename Impl>
+void set_channel(Impl &, Tcl_Channel, rank<0>) {}
+
+template<typename Impl, typename = decltype(std::declval<Impl&>().set_channel(std::declval<Tcl_Channel>()))>
+void set_channel(Impl & impl, Tcl_Channel chan, rank<1>)
+{
+  impl.set_channel(chan);
+}
+
+}
+
+/// Create a channel using impl. If impl has a `set_channel(Tcl_Channel)` member, it gets passed the new channel.
 template<typename Impl>
 Tcl_Channel create_channel(Impl & impl, const char * name, int flags = TCL_WRITABLE | TCL_READABLE)
 {
-  return Tcl_CreateChannel(&detail::channel_type<Impl>, name, &impl, flags);
+  auto chan = Tcl_CreateChannel(&detail::channel_type<Impl>, name, &impl, flags);
+  detail::set_channel(impl, chan, detail::rank<1>{});
+  return chan;
+}
+
+/** A read-only channel serving a file from a memory mapping.
+ *
+ * Input gets copied from the mapping straight into tcl's channel buffer and `seek` doesn't touch the file.
+ * C++ code can access the whole content through `data()` without any copy, e.g. by looking up a channel
+ * passed to a command with `get_mmap_channel`. Note that tcl buffers input, so the position of the script
+ * is `Tcl_Tell(chan)`, not `position()`.
+ *
+ * Only regular files can be opened, pipes & devices fail with `ESPIPE` instead of getting read up front.
+ *
+ * If created by `create_mmap_channel`, the channel owns it, otherwise it must outlive the channel.
+ */
+struct mmap_channel
+{
+  explicit mmap_channel(const char * path)
+  {
+    boost::system::error_code ec;
+    file_.open(path, ec, true);
+    if (ec)
+      throw boost::system::system_error(ec, path);
+  }
+
+  mmap_channel(const char * path, boost::system::error_code & ec)
+  {
+    file_.open(path, ec, true);
+  }
+
+  mmap_channel(const mmap_channel &) = delete;
+
+  ~mmap_channel()
+  {
+    if (timer_ != nullptr)
+      Tcl_DeleteTimerHandler(timer_);
+  }
+
+  /// The whole content of the file.
+  boost::span<const char> data() const
+  {
+    const auto c = file_.content();
+    return {c.data(), c.size()};
+  }
+
+  /// The position of the next input, i.e. the end of what tcl has buffered.
+  std::size_t position() const {return pos_;}
+
+  int input(char *buf, int to_read, int &)
+  {
+    const auto c = file_.content();
+    const auto n = (std::min)(static_cast<std::size_t>(to_read), c.size() - pos_);
+    std::memcpy(buf, c.data() + pos_, n);
+    pos_ += n;
+    return static_cast<int>(n);
+  }
+
+  int output(const char *, int, int &error)
+  {
+    error = EBADF;
+    return -1;
+  }
+
+  Tcl_WideInt seek(Tcl_WideInt offset, int mode, int &error)
+  {
+    Tcl_WideInt base = 0;
+    if (mode == SEEK_CUR)
+      base = static_cast<Tcl_WideInt>(pos_);
+    else if (mode == SEEK_END)
+      base = static_cast<Tcl_WideInt>(file_.content().size());
+
+    // like a file, seeking past the end is fine & reads nothing.
+    if (base + offset < 0)
+    {
+      error = EINVAL;
+      return -1;
+    }
+    pos_ = (std::min)(static_cast<std::size_t>(base + offset), file_.content().size());
+    return base + offset;
+  }
+
+  int set_option(Tcl_Interp *interp, const char *name, const char *)
+  {
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  int get_option(Tcl_Interp *interp, const char *name, Tcl_DString &)
+  {
+    if (name == nullptr)
+      return TCL_OK;
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  // the mapping is always readable, so a fileevent fires on every iteration of the event loop, like for files.
+  void watch(int mask)
+  {
+    watched_ = (mask & TCL_READABLE) != 0;
+    if (watched_ && timer_ == nullptr && channel_ != nullptr)
+      timer_ = Tcl_CreateTimerHandler(0, &notify_, this);
+    else if (!watched_ && timer_ != nullptr)
+    {
+      Tcl_DeleteTimerHandler(timer_);
+      timer_ = nullptr;
+    }
+  }
+
+  int close(Tcl_Interp *, int flags)
+  {
+    if (flags != 0)
+      return EINVAL;
+    if (timer_ != nullptr)
+      Tcl_DeleteTimerHandler(timer_);
+    timer_ = nullptr;
+    channel_ = nullptr;
+    if (owned_)
+      delete this;
+    return 0;
+  }
+
+  int block_mode(bool)
+  {
+    return 0;
+  }
+
+  int handler(int interest_mask)
+  {
+    return interest_mask;
+  }
+
+  void set_channel(Tcl_Channel chan) {channel_ = chan;}
+
+ private:
+  friend Tcl_Channel create_mmap_channel(Tcl_Interp *, const char *, const char *);
+
+  static void notify_(ClientData data)
+  {
+    auto & this_ = *static_cast<mmap_channel*>(data);
+    this_.timer_ = nullptr;
+    // might close the channel & delete this_
+    Tcl_NotifyChannel(this_.channel_, TCL_READABLE);
+  }
+
+  detail::mapped_file file_;
+  std::size_t pos_ = 0u;
+  Tcl_Channel channel_ = nullptr;
+  Tcl_TimerToken timer_ = nullptr;
+  bool watched_ = false;
+  bool owned_ = false;
+};
+
+inline auto tag_invoke(detail::get_class_name_tag<mmap_channel>) -> boost::core::string_view
+{
+  return "mmap";
+}
+
+/** Open a file as an `mmap_channel` that gets closed with the channel.
+ *
+ * Returns null & leaves an error in interp if the file can't be opened. The channel still needs to be registered,
+ * e.g. with `Tcl_RegisterChannel`. If no name is given, a unique one is generated.
+ */
+inline Tcl_Channel create_mmap_channel(Tcl_Interp * interp, const char * path, const char * name = nullptr)
+{
+  boost::system::error_code ec;
+  auto impl = new mmap_channel(path, ec);
+  if (ec)
+  {
+    delete impl;
+    if (interp)
+      Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't open \"%s\": %s", path, ec.message().c_str()));
+    return nullptr;
+  }
+  impl->owned_ = true;
+
+  std::string nm;
+  if (name == nullptr)
+  {
+    static std::atomic<unsigned> counter{0u};
+    nm = "mmap" + std::to_string(counter++);
+    name = nm.c_str();
+  }
+  auto chan = create_channel(*impl, name, TCL_READABLE);
+  // fewer calls into the driver, tcl limits it to 1MB
+  Tcl_SetChannelBufferSize(chan, 1024 * 1024);
+  return chan;
+}
+
+/// The `mmap_channel` of a channel, or null if it's another kind of channel.
+inline mmap_channel * get_mmap_channel(Tcl_Channel chan)
+{
+  if (chan == nullptr || Tcl_GetChannelType(chan) != &detail::channel_type<mmap_channel>)
+    return nullptr;
+  return static_cast<mmap_channel*>(Tcl_GetChannelInstanceData(chan));
+}
+
+/// Look up an `mmap_channel` by name, e.g. an argument of a command. Returns null & sets an error otherwise.
+inline mmap_channel * get_mmap_channel(Tcl_Interp * interp, const char * name)
+{
+  auto chan = Tcl_GetChannel(interp, name, nullptr);
+  if (chan == nullptr)
+    return nullptr;
+  auto res = get_mmap_channel(chan);
+  if (res == nullptr)
+    Tcl_SetObjResult(interp, Tcl_ObjPrintf("channel \"%s\" is not a memory mapped file", name));
+  return res;
+}
+
+
+/** The buffer shared by the two ends of an in-memory pipe, see `make_pipe_buffer`.
+ *
+ * A bounded single-producer/single-consumer ring buffer, so the data doesn't go through `Tcl_Obj`s
+ * or the event queue and neither end takes a lock unless it has to block.
+ */
+struct pipe_buffer
+{
+  explicit pipe_buffer(std::size_t capacity) : queue_(capacity), capacity_(capacity) {}
+  pipe_buffer(const pipe_buffer &) = delete;
+
+  std::size_t capacity() const {return capacity_;}
+
+ private:
+  friend struct pipe_channel;
+  enum side {reader = 0, writer = 1};
+
+  // wake up the other end after pushing, popping or closing.
+  void wake_(side other)
+  {
+    // pairs with the fence in wait_: either the waiter sees the change, or we see the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed) > 0)
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      cv_.notify_all();
+    }
+    if (watching_[other].load())
+      if (auto id = thread_[other].load())
+        Tcl_ThreadAlert(id);
+  }
+
+  // blocking mode only
+  template<typename Predicate>
+  void wait_(Predicate pred)
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    waiting_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_.wait(lock, pred);
+    waiting_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  boost::lockfree::spsc_queue<char> queue_;
+  const std::size_t capacity_;
+  std::atomic<bool> opened_[2] = {false, false};
+  std::atomic<bool> closed_[2] = {false, false};
+  std::atomic<bool> watching_[2] = {false, false};
+  std::atomic<Tcl_ThreadId> thread_[2] = {nullptr, nullptr};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<int> waiting_{0};
+};
+
+/// Create the buffer for a pipe between two threads. Its ends get created with `create_pipe_reader` & `create_pipe_writer`.
+inline std::shared_ptr<pipe_buffer> make_pipe_buffer(std::size_t capacity = 64u * 1024u)
+{
+  return std::make_shared<pipe_buffer>(capacity);
 }
 
+Tcl_Channel create_pipe_reader(const std::shared_ptr<pipe_buffer> & buffer, const char * name = nullptr);
+Tcl_Channel create_pipe_writer(const std::shared_ptr<pipe_buffer> & buffer, const char * name = nullptr);
+
+/** One end of an in-memory pipe, which can connect interpreters in different threads.
+ *
+ * Every end registers an event source with the thread it belongs to, which the other end wakes up
+ * with `Tcl_ThreadAlert`, so `fileevent` works across threads. A blocking end waits for the other one.
+ * The reader gets an eof once the writer is closed & the buffer is empty, writing to a pipe whose reader
+ * is closed fails with `EPIPE`.
+ *
+ * The ends can be moved to another thread like any other channel, e.g. with `thread::transfer`.
+ */
+struct pipe_channel
+{
+  pipe_channel(const pipe_channel &) = delete;
+
+  const std::shared_ptr<pipe_buffer> & buffer() const {return buffer_;}
+  /// TCL_READABLE or TCL_WRITABLE
+  int direction() const {return side_ == pipe_buffer::reader ? TCL_READABLE : TCL_WRITABLE;}
+
+  int input(char *buf, int to_read, int &error)
+  {
+    auto & q = buffer_->queue_;
+    for (;;)
+    {
+      // the writer pushes before closing, so nothing gets lost by checking first.
+      const bool eof = buffer_->closed_[pipe_buffer::writer].load();
+      const auto n = q.pop(buf, static_cast<std::size_t>(to_read));
+      if (n > 0u)
+      {
+        buffer_->wake_(pipe_buffer::writer);
+        return static_cast<int>(n);
+      }
+      if (eof)
+        return 0;
+      if (!blocking_)
+      {
+        error = EAGAIN;
+        return -1;
+      }
+      buffer_->wait_([&]{return q.read_available() > 0u || buffer_->closed_[pipe_buffer::writer].load();});
+    }
+  }
+
+  int output(const char *buf, int to_write, int &error)
+  {
+    auto & q = buffer_->queue_;
+    for (;;)
+    {
+      if (buffer_->closed_[pipe_buffer::reader].load())
+      {
+        error = EPIPE;
+        return -1;
+      }
+      const auto n = q.push(buf, static_cast<std::size_t>(to_write));
+      if (n > 0u)
+      {
+        buffer_->wake_(pipe_buffer::reader);
+        return static_cast<int>(n);
+      }
+      if (!blocking_)
+      {
+        error = EAGAIN;
+        return -1;
+      }
+      buffer_->wait_([&]{return q.write_available() > 0u || buffer_->closed_[pipe_buffer::reader].load();});
+    }
+  }
+
+  int seek(Tcl_WideInt, int, int &error)
+  {
+    error = EINVAL;
+    return -1;
+  }
+
+  int set_option(Tcl_Interp *interp, const char *name, const char *)
+  {
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  int get_option(Tcl_Interp *interp, const char *name, Tcl_DString &)
+  {
+    if (name == nullptr)
+      return TCL_OK;
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  void watch(int mask)
+  {
+    mask_ = mask & direction();
+    buffer_->watching_[side_].store(mask_ != 0);
+  }
+
+  int close(Tcl_Interp *, int flags)
+  {
+    if (flags != 0)
+      return EINVAL;
+    detach_();
+    buffer_->watching_[side_].store(false);
+    buffer_->closed_[side_].store(true);
+    buffer_->wake_(other_());
+    delete this;
+    return 0;
+  }
+
+  int block_mode(bool blocking)
+  {
+    blocking_ = blocking;
+    return 0;
+  }
+
+  int handler(int interest_mask)
+  {
+    return interest_mask;
+  }
+
+  void thread_action(int action)
+  {
+    if (action == TCL_CHANNEL_THREAD_REMOVE)
+      detach_();
+    else
+      attach_();
+  }
+
+  void set_channel(Tcl_Channel chan) {channel_ = chan;}
+
+ private:
+  friend Tcl_Channel create_pipe_reader(const std::shared_ptr<pipe_buffer> &, const char *);
+  friend Tcl_Channel create_pipe_writer(const std::shared_ptr<pipe_buffer> &, const char *);
+
+  pipe_channel(std::shared_ptr<pipe_buffer> buffer, pipe_buffer::side side) : buffer_(std::move(buffer)), side_(side) {}
+
+  static Tcl_Channel create_(const std::shared_ptr<pipe_buffer> & buffer, int direction, const char * name)
+  {
+    const auto side = direction == TCL_READABLE ? pipe_buffer::reader : pipe_buffer::writer;
+    const bool opened = buffer->opened_[side].exchange(true);
+    BOOST_ASSERT_MSG(!opened, "each end of a pipe can only be created once");
+    (void)opened;
+    std::string nm;
+    if (name == nullptr)
+    {
+      static std::atomic<unsigned> counter{0u};
+      nm = "mpipe" + std::to_string(counter++);
+      name = nm.c_str();
+    }
+    auto impl = new pipe_channel(buffer, side);
+    // Tcl_CreateChannel attaches it to the current thread through thread_action.
+    return create_channel(*impl, name, impl->direction());
+  }
+
+  struct event_ : Tcl_Event
+  {
+    pipe_channel * channel;
+  };
+
+  pipe_buffer::side other_() const {return side_ == pipe_buffer::reader ? pipe_buffer::writer : pipe_buffer::reader;}
+
+  bool ready_() const
+  {
+    if (buffer_->closed_[other_()].load())
+      return true;
+    return side_ == pipe_buffer::reader ? buffer_->queue_.read_available() > 0u : buffer_->queue_.write_available() > 0u;
+  }
+
+  void attach_()
+  {
+    // the event source must only be registered once, or one would be left behind by detach_.
+    if (buffer_->thread_[side_].exchange(Tcl_GetCurrentThread()) != nullptr)
+      return;
+    Tcl_CreateEventSource(&setup_, &check_, this);
+  }
+
+  void detach_()
+  {
+    if (buffer_->thread_[side_].exchange(nullptr) == nullptr)
+      return;
+    Tcl_DeleteEventSource(&setup_, &check_, this);
+    Tcl_DeleteEvents(+[](Tcl_Event * ev, ClientData data) -> int
+                     {
+                       return ev->proc == &event_proc_ && static_cast<event_*>(ev)->channel == data;
+                     }, this);
+    queued_ = false;
+  }
+
+  static void setup_(ClientData data, int flags)
+  {
+    auto & this_ = *static_cast<pipe_channel*>(data);
+    if ((flags & TCL_FILE_EVENTS) && this_.mask_ != 0 && this_.ready_())
+    {
+      Tcl_Time block{0, 0};
+      Tcl_SetMaxBlockTime(&block);
+    }
+  }
+
+  static void check_(ClientData data, int flags)
+  {
+    auto & this_ = *static_cast<pipe_channel*>(data);
+    if ((flags & TCL_FILE_EVENTS) && this_.mask_ != 0 && !this_.queued_ && this_.ready_())
+    {
+      auto ev = reinterpret_cast<event_*>(Tcl_Alloc(sizeof(event_)));
+      ev->proc = &event_proc_;
+      ev->channel = &this_;
+      this_.queued_ = true;
+      Tcl_QueueEvent(ev, TCL_QUEUE_TAIL);
+    }
+  }
+
+  static int event_proc_(Tcl_Event * ev, int flags)
+  {
+    if ((flags & TCL_FILE_EVENTS) == 0)
+      return 0;
+    auto & this_ = *static_cast<event_*>(ev)->channel;
+    this_.queued_ = false;
+    // might close the channel & delete this_
+    if (this_.mask_ != 0 && this_.ready_())
+      Tcl_NotifyChannel(this_.channel_, this_.mask_);
+    return 1;
+  }
+
+  std::shared_ptr<pipe_buffer> buffer_;
+  const pipe_buffer::side side_;
+  Tcl_Channel channel_ = nullptr;
+  int mask_ = 0;
+  bool blocking_ = true;
+  bool queued_ = false;
+};
+
+inline auto tag_invoke(detail::get_class_name_tag<pipe_channel>) -> boost::core::string_view
+{
+  return "mpipe";
+}
+
+/** Create the reading end of a pipe in the current thread.
+ *
+ * Like all channels it starts out blocking & still needs to be registered, e.g. with `Tcl_RegisterChannel`.
+ * If no name is given, a unique one is generated.
+ *
+ * @code
+ * auto buf = tcl::make_pipe_buffer();
+ * Tcl_RegisterChannel(interp, tcl::create_pipe_reader(buf));
+ * tcl::thread producer{[buf]
+ *   {
+ *     auto chan = tcl::create_pipe_writer(buf);
+ *     Tcl_WriteChars(chan, "hello\n", -1);
+ *     Tcl_Close(nullptr, chan);
+ *   }};
+ * @endcode
+ */
+inline Tcl_Channel create_pipe_reader(const std::shared_ptr<pipe_buffer> & buffer, const char * name)
+{
+  return pipe_channel::create_(buffer, TCL_READABLE, name);
+}
+
+/// Create the writing end of a pipe in the current thread, see `create_pipe_reader`.
+inline Tcl_Channel create_pipe_writer(const std::shared_ptr<pipe_buffer> & buffer, const char * name)
+{
+  return pipe_channel::create_(buffer, TCL_WRITABLE, name);
+}
 
 }
 
@@ -17,11 +17,20 @@
 #include <tclOO.h>
 
 #include <boost/core/detail/string_view.hpp>
-#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/describe/bases.hpp>
+#include <boost/preprocessor/seq/for_each_i.hpp>
 #include <boost/preprocessor/variadic/to_seq.hpp>
 #include <boost/mp11/list.hpp>
 #include <boost/mp11/algorithm.hpp>
 #include <boost/type_index.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <typeindex>
+#include <vector>
 
 namespace metal::tcl
 {
@@ -32,12 +41,12 @@ namespace detail
 template<typename T>
 struct get_constructors_tag {};
 
-#define METAL_TCL_DESCRIBE_CONSTRUCTORS_STEP(r, data, elem) \
-        BOOST_PP_COMMA_IF( BOOST_PP_SUB ( r , 1)) data(*) elem
+#define METAL_TCL_DESCRIBE_CONSTRUCTORS_STEP(r, data, i, elem) \
+        BOOST_PP_COMMA_IF(i) data(*) elem
 
 #define METAL_TCL_DESCRIBE_CONSTRUCTORS(Type, ...) \
 auto tag_invoke(metal::tcl::detail::get_constructors_tag<Type>) -> \
-    boost::mp11::mp_list< BOOST_PP_SEQ_FOR_EACH(METAL_TCL_DESCRIBE_CONSTRUCTORS_STEP, Type, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)) >;
+    boost::mp11::mp_list< BOOST_PP_SEQ_FOR_EACH_I(METAL_TCL_DESCRIBE_CONSTRUCTORS_STEP, Type, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__)) >;
 
 template<typename T>
 struct get_class_name_tag {};
@@ -50,21 +59,84 @@ auto tag_invoke(metal::tcl::detail::get_class_name_tag<T>) -> boost::core::strin
 }
 
 #define METAL_TCL_SET_CLASS_NAME(Type, Name) \
-auto tag_invoke(metal::tcl::detail::get_class_name_tag<Type>) -> core::string_view {return #Name;}
+auto tag_invoke(metal::tcl::detail::get_class_name_tag<Type>) -> boost::core::string_view {return #Name;}
+
+
+template<typename T>
+void * upcast_impl(void * ptr, const std::type_info & ti);
+
+// type erased operations on the C++ object held by a TclOO instance.
+struct instance_vtable
+{
+  const std::type_info & type;
+  void* (*upcast)(void * ptr, const std::type_info & ti);
+  void  (*destroy)(void * ptr);
+  void* (*clone)(void * ptr);
+};
+
+template<typename T>
+const instance_vtable & get_instance_vtable()
+{
+  static const instance_vtable vtable{
+      typeid(T),
+      &upcast_impl<T>,
+      +[](void * ptr) { delete static_cast<T*>(ptr); },
+      +[](void * ptr) -> void*
+      {
+        if constexpr (std::is_copy_constructible_v<T>)
+          return new T(*static_cast<T*>(ptr));
+        else
+          throw std::logic_error("class is not copyable");
+      }
+  };
+  return vtable;
+}
 
+// the object held by an instance, owned by the metadata.
+struct instance
+{
+  void * ptr;
+  const instance_vtable * vtable;
+
+  // get the subobject of type T, i.e. works for any described base.
+  template<typename T>
+  T * as() const
+  {
+    return static_cast<T*>(vtable->upcast(ptr, typeid(T)));
+  }
+};
 
 template<typename T>
-static Tcl_ObjectMetadataType thisMetaData {
-  TCL_OO_METHOD_VERSION_CURRENT, "this",
+void * upcast_impl(void * ptr, const std::type_info & ti)
+{
+  if (ti == typeid(T))
+    return ptr;
+
+  void * res = nullptr;
+  if constexpr (boost::describe::has_describe_bases<T>::value)
+    boost::mp11::mp_for_each<boost::describe::describe_bases<T, boost::describe::mod_public>>(
+        [&](auto base)
+        {
+          using base_type = typename decltype(base)::type;
+          if (res == nullptr)
+            res = upcast_impl<base_type>(static_cast<base_type*>(static_cast<T*>(ptr)), ti);
+        });
+  return res;
+}
+
+inline const Tcl_ObjectMetadataType instanceMetaData {
+  TCL_OO_METADATA_VERSION_CURRENT, "metal::tcl::instance",
   +[](ClientData data)
   {
-    delete static_cast<T*>(data);
+    std::unique_ptr<instance> inst{static_cast<instance*>(data)};
+    inst->vtable->destroy(inst->ptr);
   },
   +[](Tcl_Interp *interp, ClientData oldClientData, ClientData *newClientData)
   {
     try
     {
-      *newClientData = new T(*static_cast<T*>(oldClientData));
+      auto old = static_cast<instance*>(oldClientData);
+      *newClientData = new instance{old->vtable->clone(old->ptr), old->vtable};
       return TCL_OK;
     }
     catch(...)
@@ -76,14 +148,16 @@ static Tcl_ObjectMetadataType thisMetaData {
   }
 };
 
-template<typename T>
-static Tcl_ObjectMetadataType typeMetaData {
-    TCL_OO_METHOD_VERSION_CURRENT, "this",
-    nullptr,
-    nullptr
-};
+inline instance * get_instance(Tcl_Object obj)
+{
+  return static_cast<instance*>(Tcl_ObjectGetMetadata(obj, &instanceMetaData));
+}
 
+template<typename T, typename = void>
+struct has_constructors : std::false_type {};
 
+template<typename T>
+struct has_constructors<T, std::void_t<decltype(tag_invoke(get_constructors_tag<T>{}))>> : std::true_type {};
 
 struct constructor_call_equal
 {
@@ -236,8 +310,7 @@ try
   if (res)
   {
     auto ctx = Tcl_ObjectContextObject(objectContext);
-    Tcl_ObjectSetMetadata(ctx, &thisMetaData<T>, res);
-    Tcl_ObjectSetMetadata(ctx, &typeMetaData<T>, const_cast<std::type_info*>(&typeid(res)));
+    Tcl_ObjectSetMetadata(ctx, &instanceMetaData, new instance{res, &get_instance_vtable<T>()});
     return TCL_OK;
   }
   constexpr char msg[] = "no constructor";
@@ -260,24 +333,6 @@ const Tcl_MethodType constructorType{
     nullptr
 };
 
-template<typename T>
-const Tcl_MethodType destructorType{
-    TCL_OO_METHOD_VERSION_CURRENT,
-    "destructor",
-    [](ClientData clientData, Tcl_Interp *interp,
-       Tcl_ObjectContext objectContext, int objc, Tcl_Obj *const *objv)
-    {
-      auto ctx = Tcl_ObjectContextObject(objectContext);
-      auto this_ = Tcl_ObjectGetMetadata(ctx, &thisMetaData<T>);
-      if (this_ != nullptr)
-        delete static_cast<T*>(this_);
-      return TCL_OK;
-    },
-    nullptr,
-    nullptr
-};
-
-
 template<typename T>
 struct method_call_equal
 {
@@ -292,7 +347,7 @@ struct method_call_equal
   void call_impl(const Descriptor & descr, Types *,
                   std::true_type /* is void */, std::index_sequence<Idx...> )
   {
-    const bool all_equal = (is_equal_type<boost::mp11::mp_at_c<Types, Idx>>(interp, objv[Idx]) && ...);
+    const bool all_equal = (is_equal_type<boost::mp11::mp_at_c<Types, Idx + 1>>(interp, objv[Idx]) && ...);
     if (all_equal)
     {
       (this_->*Descriptor::pointer)(*try_cast<boost::mp11::mp_at_c<Types, Idx + 1>>(interp, objv[Idx])...);
@@ -304,7 +359,7 @@ struct method_call_equal
   void call_impl(const Descriptor & descr, Types *,
                  std::false_type /* is void */ , std::index_sequence<Idx...> )
   {
-    const bool all_equal = (is_equal_type<boost::mp11::mp_at_c<Types, Idx>>(interp, objv[Idx]) && ...);
+    const bool all_equal = (is_equal_type<boost::mp11::mp_at_c<Types, Idx + 1>>(interp, objv[Idx]) && ...);
     if (all_equal)
     {
       auto res = (this_->*Descriptor::pointer)(*try_cast<boost::mp11::mp_at_c<Types, Idx + 1>>(interp, objv[Idx])...);
@@ -494,12 +549,18 @@ int method_impl(ClientData clientData, Tcl_Interp *interp,
                 Tcl_ObjectContext objectContext, int objc, Tcl_Obj *const *objv)
 try
 {
+  // inherited methods are registered with the TclOO class of the base
   using descriptor = boost::describe::describe_members<T,
-                      boost::describe::mod_inherited | boost::describe::mod_function | boost::describe::mod_public >;
+                      boost::describe::mod_function | boost::describe::mod_public >;
 
-  auto ctx = Tcl_ObjectContextObject(objectContext);
-  auto this_ = static_cast<T*>(Tcl_ObjectGetMetadata(ctx, &thisMetaData<T>));
-  assert(this_ != nullptr);
+  auto inst = get_instance(Tcl_ObjectContextObject(objectContext));
+  auto this_ = inst ? inst->template as<T>() : nullptr;
+  if (this_ == nullptr)
+  {
+    constexpr char msg[] = "object holds no instance of the class";
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(msg, sizeof(msg) - 1));
+    return TCL_ERROR;
+  }
   const int skip = Tcl_ObjectContextSkippedArgs(objectContext);
 
   objc -= skip;
@@ -545,157 +606,301 @@ const Tcl_MethodType & getMethodType(const char * name)
   return methodType;
 }
 
+// the overloads of a static method, built once per type & name so a call doesn't need to scan the descriptors.
+struct static_method : sub_command
+{
+  using sub_command::invoke_;
+};
+
 template<typename T>
-int static_method_impl(ClientData clientData, Tcl_Interp *interp,
-                Tcl_ObjectContext objectContext, int objc, Tcl_Obj *const *objv)
-try
+boost::unordered_map<std::string, static_method> & static_method_table()
 {
-  const int skip = Tcl_ObjectContextSkippedArgs(objectContext);
+  static boost::unordered_map<std::string, static_method> table = []{
+    boost::unordered_map<std::string, static_method> res;
+    using descriptors = boost::describe::describe_members<T,
+                          boost::describe::mod_inherited | boost::describe::mod_function |
+                          boost::describe::mod_public | boost::describe::mod_static >;
+    boost::mp11::mp_for_each<descriptors>(
+        [&](auto descr)
+        {
+          res[descr.name].add_function(descr.pointer);
+        });
+    return res;
+  }();
+  return table;
+}
 
-  objc -= skip;
-  objv += skip;
+inline int static_method_impl(ClientData clientData, Tcl_Interp *interp,
+                              Tcl_ObjectContext objectContext, int objc, Tcl_Obj *const *objv)
+{
+  // invoke_ expects the arguments to start at objv[1], i.e. the method name is objv[0]
+  const int skip = Tcl_ObjectContextSkippedArgs(objectContext) - 1;
+  return static_cast<static_method*>(clientData)->invoke_(interp, objc - skip, objv + skip);
+}
 
-  objc ++;
-  objv --;
+inline const Tcl_MethodType staticMethodType{
+    TCL_OO_METHOD_VERSION_CURRENT,
+    "static method",
+    &static_method_impl,
+    nullptr,
+    nullptr
+};
 
-  const auto meth = Tcl_MethodName(Tcl_ObjectContextMethod(objectContext));
-  const boost::core::string_view name{meth->bytes, static_cast<std::size_t>(meth->length)};
+// per interpreter cache of the classes registered from C++, so lookups don't need to go through the class name.
+struct class_registry : std::enable_shared_from_this<class_registry>
+{
+  struct entry
+  {
+    Tcl_Class cls = nullptr;
+    Tcl_Command stub = nullptr; // set by declare_class until the class gets materialized
+  };
 
-  using descriptors = boost::describe::describe_members<T,
-                    boost::describe::mod_inherited | boost::describe::mod_function |
-                    boost::describe::mod_public | boost::describe::mod_static >;
+  Tcl_Class oo_class = nullptr;
+  boost::unordered_map<std::type_index, entry> classes;
+};
 
-  int res = TCL_CONTINUE;
-  boost::mp11::mp_for_each<descriptors>(
-      [&](auto descr)
-      {
-        if (res != TCL_CONTINUE && descr.name == name)
-          res = overload_traits<decltype(descr.pointer)>::call_equal(descr.pointer, interp, objc, objv);
-      });
-  if (res != TCL_CONTINUE)
-    boost::mp11::mp_for_each<descriptors>(
-          [&](auto descr)
-            {
-              if (res != TCL_CONTINUE && descr.name == name)
-                res = overload_traits<decltype(descr.pointer)>::call_equivalent(descr.pointer, interp, objc, objv);
-            });
-  if (res != TCL_CONTINUE)
-    boost::mp11::mp_for_each<descriptors>(
-          [&](auto descr)
-            {
-              if (res != TCL_CONTINUE && descr.name == name)
-                res = overload_traits<decltype(descr.pointer)>::call_castable(descr.pointer, interp, objc, objv);
-            });
-  if (res != TCL_CONTINUE)
-    boost::mp11::mp_for_each<descriptors>(
-        [&](auto descr)
+struct class_registry_ref
+{
+  std::weak_ptr<class_registry> registry;
+  std::type_index type;
+  Tcl_Command stub = nullptr;
+};
+
+inline class_registry & get_class_registry(Tcl_Interp * interp)
+{
+  constexpr char key[] = "metal::tcl::class_registry";
+  auto p = static_cast<std::shared_ptr<class_registry>*>(Tcl_GetAssocData(interp, key, nullptr));
+  if (p == nullptr)
+  {
+    p = new std::shared_ptr<class_registry>(std::make_shared<class_registry>());
+    Tcl_SetAssocData(interp, key,
+                     +[](ClientData clientData, Tcl_Interp *)
+                     {
+                       delete static_cast<std::shared_ptr<class_registry>*>(clientData);
+                     }, p);
+  }
+  return **p;
+}
+
+// attached to every registered class, so deleting the class removes it from the registry.
+inline const Tcl_ObjectMetadataType classRegistryMetaData{
+    TCL_OO_METADATA_VERSION_CURRENT, "metal::tcl::class_registry",
+    +[](ClientData data)
+    {
+      std::unique_ptr<class_registry_ref> ref{static_cast<class_registry_ref*>(data)};
+      if (auto reg = ref->registry.lock())
+        reg->classes.erase(ref->type);
+    },
+    +[](Tcl_Interp *, ClientData, ClientData * newClientData)
+    {
+      // a copied class is not the registered one
+      *newClientData = nullptr;
+      return TCL_OK;
+    }
+};
+
+// the unique names of the described methods, computed once per type.
+template<typename T, unsigned Modifiers>
+const std::vector<const char*> & method_table()
+{
+  static const std::vector<const char*> table = []{
+    std::vector<const char*> res;
+    boost::mp11::mp_for_each<boost::describe::describe_members<T, Modifiers>>(
+        [&](auto desc)
         {
-          if (res != TCL_CONTINUE && descr.name == name)
-            res = overload_traits<decltype(descr.pointer)>::call_with_string(descr.pointer, interp, objc, objv);
+          auto itr = std::find_if(res.begin(), res.end(),
+                                  [&](const char * nm) { return std::strcmp(nm, desc.name) == 0; });
+          if (itr == res.end())
+            res.push_back(desc.name);
         });
+    return res;
+  }();
+  return table;
+}
 
-  if (res == TCL_CONTINUE)
-    return TCL_OK;
+template<typename T>
+int class_stub_impl(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj * const objv[]);
 
-  constexpr char msg[] = "no method";
-  Tcl_SetObjResult(interp, Tcl_NewStringObj(msg, sizeof(msg) - 1));
-  return TCL_ERROR;
 }
-catch (...)
+
+template<typename T>
+Tcl_Class register_class(Tcl_Interp * interp);
+
+namespace detail
 {
-  auto obj = ::metal::tcl::make_exception_object();
-  Tcl_SetObjResult(interp, obj.get());
-  return TCL_ERROR;
-}
 
 template<typename T>
-const Tcl_MethodType & getStaticMethodType(const char * name)
+Tcl_Class create_class(Tcl_Interp * interp, class_registry & reg, boost::core::string_view cl_name)
 {
-  static const Tcl_MethodType staticMethodType{
-      TCL_OO_METHOD_VERSION_CURRENT,
-      name,
-      &static_method_impl<T>,
-      nullptr,
-      nullptr
-  };
-  return staticMethodType;
+  if (reg.oo_class == nullptr)
+  {
+    object_ptr oo_class_name = Tcl_NewStringObj("::oo::class", -1);
+    auto classobj = Tcl_GetObjectFromObj(interp, oo_class_name.get());
+    if (classobj == nullptr)
+      return nullptr;
+    reg.oo_class = Tcl_GetObjectAsClass(classobj);
+  }
+
+  auto o = Tcl_NewObjectInstance(interp, reg.oo_class, std::string(cl_name).c_str(), nullptr, 0, nullptr, 0);
+  if (o == nullptr)
+    return nullptr;
+  auto cl = Tcl_GetObjectAsClass(o);
+
+  if constexpr (has_constructors<T>::value)
+  {
+    auto ctor = Tcl_NewInstanceMethod(interp, o, nullptr, 1, &constructorType<T>, nullptr);
+    Tcl_ClassSetConstructor(interp, cl, ctor);
+  }
+
+  // described bases become superclasses, so their methods are only registered once.
+  if constexpr (boost::describe::has_describe_bases<T>::value)
+  {
+    using bases = boost::describe::describe_bases<T, boost::describe::mod_public>;
+    if constexpr (boost::mp11::mp_size<bases>::value > 0)
+    {
+      object_ptr cmd = Tcl_NewListObj(0, nullptr);
+      Tcl_ListObjAppendElement(interp, cmd.get(), Tcl_NewStringObj("::oo::define", -1));
+      Tcl_ListObjAppendElement(interp, cmd.get(), Tcl_GetObjectName(interp, o));
+      Tcl_ListObjAppendElement(interp, cmd.get(), Tcl_NewStringObj("superclass", -1));
+
+      bool failed = false;
+      boost::mp11::mp_for_each<bases>(
+          [&](auto base)
+          {
+            if (failed)
+              return;
+            auto base_cl = register_class<typename decltype(base)::type>(interp);
+            if (base_cl == nullptr)
+              failed = true;
+            else
+              Tcl_ListObjAppendElement(interp, cmd.get(), Tcl_GetObjectName(interp, Tcl_GetClassAsObject(base_cl)));
+          });
+
+      int len;
+      Tcl_Obj ** objv;
+      Tcl_ListObjGetElements(interp, cmd.get(), &len, &objv);
+      if (failed || Tcl_EvalObjv(interp, len, objv, TCL_EVAL_GLOBAL) != TCL_OK)
+      {
+        object_ptr err = Tcl_GetObjResult(interp);
+        Tcl_DeleteCommandFromToken(interp, Tcl_GetObjectCommand(o));
+        Tcl_SetObjResult(interp, err.get());
+        return nullptr;
+      }
+    }
+  }
+
+  for (auto name : method_table<T, boost::describe::mod_function | boost::describe::mod_public>())
+    Tcl_NewMethod(interp, cl, Tcl_NewStringObj(name, -1), 1, &getMethodType<T>(name), nullptr);
+
+  // static methods are methods of the class object itself
+  for (auto & [name, method] : static_method_table<T>())
+    Tcl_NewInstanceMethod(interp, o, Tcl_NewStringObj(name.data(), name.size()), 1, &staticMethodType, &method);
+
+  Tcl_ClassSetMetadata(cl, &classRegistryMetaData,
+                       new class_registry_ref{reg.shared_from_this(), typeid(T)});
+  return cl;
 }
 
 }
 
 
+/// Registers the class `T` with the interpreter or returns the already registered one.
 template<typename T>
 Tcl_Class register_class(Tcl_Interp * interp)
 {
+  auto & reg = detail::get_class_registry(interp);
+  auto itr = reg.classes.find(typeid(T));
+  if (itr != reg.classes.end() && itr->second.cls != nullptr)
+    return itr->second.cls;
+
   auto cl_name = tag_invoke(detail::get_class_name_tag<T>{});
-  object_ptr className = Tcl_NewStringObj(cl_name.data(), cl_name.size());
+  if (itr != reg.classes.end() && itr->second.stub != nullptr)
+  {
+    // declared lazily, so we need to remove the placeholder command first.
+    auto stub = std::exchange(itr->second.stub, nullptr);
+    Tcl_DeleteCommandFromToken(interp, stub);
+  }
+  else
+  {
+    object_ptr className = Tcl_NewStringObj(cl_name.data(), cl_name.size());
+    Tcl_Object existing = Tcl_GetObjectFromObj(interp, className.get());
+    if (existing != nullptr)
+      return reg.classes[typeid(T)].cls = Tcl_GetObjectAsClass(existing);
+    Tcl_ResetResult(interp);
+  }
 
-  Tcl_Object existing = Tcl_GetObjectFromObj(interp, className.get());
-  if (existing != nullptr)
-    return Tcl_GetObjectAsClass(existing);
+  auto cl = detail::create_class<T>(interp, reg, cl_name);
+  if (cl != nullptr)
+    reg.classes[typeid(T)].cls = cl;
+  else
+    reg.classes.erase(typeid(T));
+  return cl;
+}
 
-  auto classobj = Tcl_GetObjectFromObj(interp, Tcl_NewStringObj("::oo::class" ,-1));
-  auto class_ = Tcl_GetObjectAsClass(classobj);
-  auto o = Tcl_NewObjectInstance(interp, class_, cl_name.data(), nullptr ,0 ,nullptr ,0);
-  auto cl = Tcl_GetObjectAsClass(o);
+/// Declares the class `T`, but only registers it with TclOO when its name is first used.
+template<typename T>
+void declare_class(Tcl_Interp * interp)
+{
+  auto & reg = detail::get_class_registry(interp);
+  auto & entry = reg.classes[typeid(T)];
+  if (entry.cls != nullptr || entry.stub != nullptr)
+    return;
 
-  auto ctor = Tcl_NewInstanceMethod(interp, o, nullptr, 1, &detail::constructorType<T>, nullptr);
-  Tcl_ClassSetConstructor(interp, cl, ctor);
+  auto cl_name = tag_invoke(detail::get_class_name_tag<T>{});
+  auto ref = new detail::class_registry_ref{reg.shared_from_this(), typeid(T)};
+  ref->stub = entry.stub = Tcl_CreateObjCommand(
+      interp, std::string(cl_name).c_str(), &detail::class_stub_impl<T>, ref,
+      +[](ClientData clientData)
+      {
+        std::unique_ptr<detail::class_registry_ref> ref{static_cast<detail::class_registry_ref*>(clientData)};
+        auto reg = ref->registry.lock();
+        if (!reg)
+          return;
+        auto itr = reg->classes.find(ref->type);
+        // the placeholder got deleted by the user, i.e. not by register_class
+        if (itr != reg->classes.end() && itr->second.stub == ref->stub)
+          reg->classes.erase(itr);
+      });
+}
 
-  auto dtor = Tcl_NewInstanceMethod(interp, o, nullptr, 1, &detail::destructorType<T>, nullptr);
-  Tcl_ClassSetDestructor(interp, cl, dtor);
+/// Registers all classes at once.
+template<typename ... Ts>
+std::array<Tcl_Class, sizeof...(Ts)> register_classes(Tcl_Interp * interp)
+{
+  return {register_class<Ts>(interp)...};
+}
 
-  using methods = boost::describe::describe_members<T,
-      boost::describe::mod_inherited | boost::describe::mod_function | boost::describe::mod_public >;
+/// Declares all classes at once, so they get registered on first use.
+template<typename ... Ts>
+void declare_classes(Tcl_Interp * interp)
+{
+  (declare_class<Ts>(interp), ...);
+}
 
-  std::array<const char*, boost::mp11::mp_size<methods>::value> method_names;
-  auto itr = method_names.begin();
+template<typename T>
+Tcl_Class register_class(const interpreter_ptr & interp)
+{
+  return register_class<T>(interp.get());
+}
 
-  boost::mp11::mp_for_each<methods>(
-      [&](auto desc)
-      {
-        auto it = std::find_if(
-            method_names.begin(), itr,
-            [&](const char * nm)
-            {
-               return std::strcmp(nm, desc.name) == 0;
-            });
-
-        if (it == itr)
-        {
-          *it = desc.name;
-          Tcl_NewMethod(interp, cl,
-                        Tcl_NewStringObj(desc.name, -1), 1,
-                        &detail::getMethodType<T>(desc.name),
-                        nullptr);
-        }
-      });
+template<typename T>
+void declare_class(const interpreter_ptr & interp)
+{
+  declare_class<T>(interp.get());
+}
 
+namespace detail
+{
 
-  using static_methods = boost::describe::describe_members<T,
-      boost::describe::mod_inherited | boost::describe::mod_function |
-      boost::describe::mod_public | boost::describe::mod_static >;
+template<typename T>
+int class_stub_impl(ClientData, Tcl_Interp *interp, int objc, Tcl_Obj * const objv[])
+{
+  if (register_class<T>(interp) == nullptr)
+    return TCL_ERROR;
+  // the name now refers to the actual class
+  return Tcl_EvalObjv(interp, objc, objv, 0);
+}
 
-  std::array<const char*, boost::mp11::mp_size<static_methods>::value> static_method_names;
-  itr = static_method_names.begin();
-  boost::mp11::mp_for_each<static_methods>(
-      [&](auto desc)
-      {
-        auto it = std::find_if(
-            static_method_names.begin(), itr,
-            [&](const char * nm)
-            {
-              return std::strcmp(nm, desc.name) == 0;
-            });
-        if (it == itr)
-        {
-          *it = desc.name;
-          Tcl_NewInstanceMethod(interp, o,
-                                Tcl_NewStringObj(desc.name, -1), 1,
-                                &detail::getStaticMethodType<T>(desc.name), nullptr);
-        }
-      });
-  return cl;
 }
 
 template<typename T>
@@ -710,12 +915,8 @@ auto tag_invoke(
   if (obj == nullptr)
     return nullptr;
 
-  auto tt = Tcl_ObjectGetMetadata(obj, &detail::typeMetaData<T>);
-  if (!tt || (*static_cast<std::type_info*>(tt) == typeid(T)))
-    return nullptr;
-
-  tt = Tcl_ObjectGetMetadata(obj, &detail::thisMetaData<T>);
-  return static_cast<T*>(tt);
+  auto inst = detail::get_instance(obj);
+  return inst ? inst->template as<T>() : nullptr;
 }
 
 
@@ -729,19 +930,21 @@ auto tag_invoke(
 
   auto obj = Tcl_GetObjectFromObj(interp, val);
   if (obj == nullptr)
-    return nullptr;
+    return false;
 
-  auto tt = Tcl_ObjectGetMetadata(obj, &detail::typeMetaData<T>);
-  return tt && (*static_cast<std::type_info*>(tt) == typeid(T));
+  auto inst = detail::get_instance(obj);
+  return inst && (inst->vtable->type == typeid(T));
 }
 
 template<typename T>
 inline auto tag_invoke(const convert_tag &, Tcl_Interp* interp, T && t)
     -> std::enable_if_t<boost::describe::has_describe_members<T>::value, object_ptr>
 {
+  // hits the per-interpreter registry after the first call
   auto cl = register_class<std::decay_t<T>>(interp);
+  if (cl == nullptr)
+    return nullptr;
 
-  auto cl_name = tag_invoke(detail::get_class_name_tag<T>{});
   static char internalConstructorMarker[] = "metal::tcl::constructor::helper";
   Tcl_Obj objv[1] = {
       0, internalConstructorMarker,
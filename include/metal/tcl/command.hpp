@@ -17,7 +17,6 @@
 #include <boost/describe/members.hpp>
 #include <boost/unordered_map.hpp>
 
-#include <metal/tcl/class.hpp>
 #include <metal/tcl/exception.hpp>
 #include <metal/tcl/enum.hpp>
 #include <metal/tcl/detail/overload_traits.hpp>
@@ -178,7 +177,7 @@ struct sub_command
   protected:
     int invoke_(Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
     {
-        if (objc > 1 &&
+        if (objc > 1 && !sub_commands_.empty() &&
             (!objv[1]->typePtr ||
               objv[1]->typePtr->name == boost::core::string_view("string")))
         {
@@ -232,6 +231,7 @@ struct sub_command
 struct command : sub_command
 {
     friend command & create_command(Tcl_Interp *interp, const char * name);
+    friend command & create_nr_command(Tcl_Interp *interp, const char * name);
 
     Tcl_CmdInfo info(boost::system::error_code & ec)
     {
@@ -241,8 +241,25 @@ struct command : sub_command
     }
     Tcl_Command cmd() {return cmd_;}
 
+    /// Get the command from its info, if it was created by `create_command`.
+    static command * from_info(const Tcl_CmdInfo & info)
+    {
+        return info.objProc == &command::proc_ ? static_cast<command*>(info.objClientData) : nullptr;
+    }
+
+    /// Invoke the command directly, without going through tcl's dispatch.
+    int invoke(Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
+    {
+        return invoke_(interp, objc, objv);
+    }
+
   private:
 
+    static int proc_(ClientData cdata, Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
+    {
+        return static_cast<command*>(cdata)->invoke_(interp, objc, objv);
+    }
+
     explicit command() {}
     Tcl_Command cmd_ = nullptr;
 };
@@ -250,11 +267,7 @@ struct command : sub_command
 inline command & create_command(Tcl_Interp *interp, const char * name)
 {
     auto cd = new command;
-    cd->cmd_ = Tcl_CreateObjCommand(interp, name,
-                         +[](ClientData cdata, Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
-                         {
-                            return static_cast<command*>(cdata)->invoke_(interp, objc, objv);
-                         }, cd,
+    cd->cmd_ = Tcl_CreateObjCommand(interp, name, &command::proc_, cd,
                          +[](ClientData cdata) { delete static_cast<command*>(cdata); });
     return *cd;
 }
@@ -266,4 +279,7 @@ inline command & create_command(const interpreter_ptr & interp, const char * nam
 
 }
 
+// class.hpp builds on sub_command, so it can only be included after it's defined.
+#include <metal/tcl/class.hpp>
+
 #endif //METAL_TCL_COMMAND_HPP
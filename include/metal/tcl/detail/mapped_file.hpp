@@ -0,0 +1,155 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_DETAIL_MAPPED_FILE_HPP
+#define METAL_TCL_DETAIL_MAPPED_FILE_HPP
+
+#include <boost/core/detail/string_view.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace metal::tcl::detail
+{
+
+// identifies a version of a file without reading it.
+struct file_stamp
+{
+  std::int64_t mtime_ns = 0;
+  std::uint64_t size = 0u;
+
+  bool operator==(const file_stamp & rhs) const {return mtime_ns == rhs.mtime_ns && size == rhs.size;}
+  bool operator!=(const file_stamp & rhs) const {return !(*this == rhs);}
+};
+
+inline file_stamp make_file_stamp(const struct stat & st)
+{
+#if defined(__APPLE__)
+  const auto & ts = st.st_mtimespec;
+#else
+  const auto & ts = st.st_mtim;
+#endif
+  return file_stamp{static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec,
+                    static_cast<std::uint64_t>(st.st_size)};
+}
+
+inline file_stamp stat_file(const char * path, boost::system::error_code & ec)
+{
+  struct stat st;
+  if (::stat(path, &st) != 0)
+  {
+    ec.assign(errno, boost::system::system_category());
+    return {};
+  }
+  return make_file_stamp(st);
+}
+
+// 64 bit FNV-1a
+inline std::uint64_t hash_content(boost::core::string_view data)
+{
+  std::uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : data)
+  {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// read-only mapping of a whole file, falls back to reading it if it can't be mapped (e.g. a pipe).
+struct mapped_file
+{
+  mapped_file() = default;
+  mapped_file(const mapped_file & ) = delete;
+  mapped_file& operator=(const mapped_file & ) = delete;
+
+  ~mapped_file()
+  {
+    if (mapped_ != nullptr)
+      ::munmap(mapped_, size_);
+  }
+
+  // regular_only fails with ESPIPE instead of reading a pipe or device, which might never end.
+  void open(const char * path, boost::system::error_code & ec, bool regular_only = false)
+  {
+    // opening a fifo would wait for a writer
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC | (regular_only ? O_NONBLOCK : 0));
+    if (fd == -1)
+    {
+      ec.assign(errno, boost::system::system_category());
+      return;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      ec.assign(errno, boost::system::system_category());
+      ::close(fd);
+      return;
+    }
+    if (regular_only && !S_ISREG(st.st_mode))
+    {
+      ec.assign(S_ISDIR(st.st_mode) ? EISDIR : ESPIPE, boost::system::system_category());
+      ::close(fd);
+      return;
+    }
+    stamp_ = make_file_stamp(st);
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+      auto p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        mapped_ = p;
+        size_ = static_cast<std::size_t>(st.st_size);
+        ::close(fd);
+        return;
+      }
+    }
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) != 0)
+    {
+      if (n == -1)
+      {
+        if (errno == EINTR)
+          continue;
+        ec.assign(errno, boost::system::system_category());
+        break;
+      }
+      buffer_.append(buf, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+  }
+
+  boost::core::string_view content() const
+  {
+    if (mapped_ != nullptr)
+      return {static_cast<const char*>(mapped_), size_};
+    return buffer_;
+  }
+
+  const file_stamp & stamp() const {return stamp_;}
+
+ private:
+  void * mapped_ = nullptr;
+  std::size_t size_ = 0u;
+  std::string buffer_;
+  file_stamp stamp_;
+};
+
+}
+
+#endif //METAL_TCL_DETAIL_MAPPED_FILE_HPP
@@ -0,0 +1,222 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_DIRECT_HPP
+#define METAL_TCL_DIRECT_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/command.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+#include <metal/tcl/parse.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+#include <boost/system/result.hpp>
+
+#include <string>
+#include <vector>
+
+namespace metal::tcl
+{
+
+/** A script of literal calls to metal commands, that gets executed without tcl's compiler.
+ *
+ * If every command of the script is a command created by `create_command` and all its words are literals
+ * (no substitutions, no `{*}`), the script gets split into a flat list of calls once.
+ * Evaluating it invokes the commands directly with the literal objects, which keep their converted values
+ * between evaluations.
+ *
+ * Any other script gets evaluated normally. Command names are resolved on every evaluation, so a command
+ * that got replaced by something else gets called through tcl.
+ *
+ * Direct calls skip what `Tcl_EvalObjv` does around every command: they don't count towards `info cmdcount`
+ * and don't fire execution traces. If a command or time limit is set, e.g. by an `eval` with `eval_limits`,
+ * or an async handler is pending, which includes a cancellation, the calls go through `Tcl_EvalObjv` instead.
+ *
+ * @code
+ * tcl::direct_script cfg{interp, "set-port 8080\nset-host localhost\nenable-tls true"};
+ * assert(cfg.direct());
+ * cfg.evaluate().value();
+ * @endcode
+ */
+struct direct_script
+{
+  direct_script(Tcl_Interp * interp, boost::core::string_view script)
+      : interp_(interp), script_(script)
+  {
+    compile_();
+  }
+
+  direct_script(const interpreter_ptr & interp, boost::core::string_view script)
+      : direct_script(interp.get(), script)
+  {
+  }
+
+  direct_script(const direct_script & ) = delete;
+  direct_script& operator=(const direct_script & ) = delete;
+
+  ~direct_script()
+  {
+    for (auto obj : objs_)
+      Tcl_DecrRefCount(obj);
+  }
+
+  /// Whether the script gets executed directly.
+  bool direct() const {return direct_;}
+
+  template<typename T = object_ptr>
+  result<T> evaluate()
+  {
+    const int res = direct_ ? execute_() : detail::eval_cached(interp_, script_, 0);
+    if constexpr (std::is_void_v<T>)
+    {
+      if (res != TCL_OK)
+        return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp_)};
+      return result<void>{boost::system::in_place_value};
+    }
+    else
+    {
+      if (res != TCL_OK)
+        return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp_)};
+      return result<T>{boost::system::in_place_value, cast<T>(interp_, Tcl_GetObjResult(interp_))};
+    }
+  }
+
+  Tcl_Interp * interpreter() const {return interp_;}
+
+ private:
+  struct call
+  {
+    // offset & size of the command in the script, for the error info.
+    std::size_t offset, size;
+    // offset into objs_, the first one is the command name
+    std::size_t first, count;
+  };
+
+  void compile_()
+  {
+    auto st = Tcl_SaveInterpState(interp_, TCL_OK);
+    direct_ = try_compile_();
+    Tcl_RestoreInterpState(interp_, st);
+
+    if (!direct_)
+    {
+      for (auto obj : objs_)
+        Tcl_DecrRefCount(obj);
+      calls_.clear();
+      objs_.clear();
+    }
+  }
+
+  bool try_compile_()
+  {
+    parse_result pr;
+    boost::core::string_view rest = script_;
+    while (!rest.empty())
+    {
+      if (!parse_command(interp_, pr, rest))
+        return false;
+
+      const auto cmd = pr.command();
+      const std::size_t consumed = cmd.data() + cmd.size() - rest.data();
+      rest.remove_prefix(consumed);
+
+      if (pr.numWords == 0)
+      {
+        if (consumed == 0u)
+          break;
+        continue;
+      }
+
+      // without the terminating newline or semicolon
+      const auto text = cmd.substr(0u, cmd.find_last_not_of(" \t\r\n;") + 1u);
+      call c{static_cast<std::size_t>(text.data() - script_.data()), text.size(), objs_.size(),
+             static_cast<std::size_t>(pr.numWords)};
+      for (auto & tk : pr.tokens())
+      {
+        if (tk.type == TCL_TOKEN_WORD || tk.type == TCL_TOKEN_EXPAND_WORD)
+          return false;
+        if (tk.type == TCL_TOKEN_SIMPLE_WORD)
+        {
+          // the text component is the word without braces or quotes
+          const auto & text = (&tk)[1];
+          objs_.push_back(Tcl_NewStringObj(text.start, text.size));
+          Tcl_IncrRefCount(objs_.back());
+        }
+      }
+
+      // only commands created with create_command
+      Tcl_Command token = Tcl_GetCommandFromObj(interp_, objs_[c.first]);
+      Tcl_CmdInfo info;
+      if (token == nullptr || !Tcl_GetCommandInfoFromToken(token, &info) || command::from_info(info) == nullptr)
+        return false;
+
+      calls_.push_back(c);
+    }
+    return true;
+  }
+
+  // limits & async handlers, i.e. signals & cancellation, are checked by Tcl_EvalObjv.
+  bool needs_eval_() const
+  {
+    return Tcl_LimitTypeEnabled(interp_, TCL_LIMIT_COMMANDS) || Tcl_LimitTypeEnabled(interp_, TCL_LIMIT_TIME)
+        || Tcl_AsyncReady();
+  }
+
+  int execute_()
+  {
+    // a script without any commands results in an empty string
+    Tcl_ResetResult(interp_);
+    for (const auto & c : calls_)
+    {
+      Tcl_Obj * const * objv = objs_.data() + c.first;
+      const int objc = static_cast<int>(c.count);
+
+      int res;
+      // the name object caches the resolved command, so this is cheap unless the command got changed.
+      Tcl_Command token = Tcl_GetCommandFromObj(interp_, objv[0]);
+      Tcl_CmdInfo info;
+      command * cmd = nullptr;
+      if (token != nullptr && Tcl_GetCommandInfoFromToken(token, &info) && !needs_eval_())
+        cmd = command::from_info(info);
+
+      if (cmd != nullptr)
+      {
+        Tcl_ResetResult(interp_);
+        res = cmd->invoke(interp_, objc, objv);
+      }
+      else
+        res = Tcl_EvalObjv(interp_, objc, objv, 0);
+
+      if (res != TCL_OK)
+      {
+        if (res == TCL_ERROR)
+        {
+          object_ptr msg = Tcl_ObjPrintf("\n    while executing\n\"%.*s\"", static_cast<int>(c.size),
+                                         script_.data() + c.offset);
+          Tcl_AppendObjToErrorInfo(interp_, msg.get());
+        }
+        return res;
+      }
+    }
+    return TCL_OK;
+  }
+
+  Tcl_Interp * interp_;
+  std::string script_;
+  bool direct_ = false;
+  std::vector<call> calls_;
+  // the literal words of all calls, each holds a reference
+  std::vector<Tcl_Obj*> objs_;
+};
+
+}
+
+#endif //METAL_TCL_DIRECT_HPP
@@ -11,22 +11,159 @@
 #include <tcl.h>
 #include <metal/tcl/exception.hpp>
 #include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/detail/mapped_file.hpp>
 #include <metal/tcl/object.hpp>
 
 #include <boost/core/detail/string_view.hpp>
 #include <boost/core/span.hpp>
 #include <boost/system/result.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <list>
+#include <string>
+#include <string_view>
 
 namespace metal::tcl
 {
 
+/// Metrics of the per-interpreter script cache used by `eval` & `global_eval`.
+struct script_cache_stats
+{
+  std::size_t hits     = 0u;
+  std::size_t misses   = 0u;
+  std::size_t size     = 0u;
+  std::size_t capacity = 0u;
+
+  double hit_rate() const
+  {
+    const auto total = hits + misses;
+    return total == 0u ? 0. : static_cast<double>(hits) / total;
+  }
+};
+
+namespace detail
+{
+
+// LRU cache of script objects, keyed by their text. The objects keep their bytecode, so a cache hit
+// skips parsing & compilation.
+struct script_cache
+{
+  struct entry
+  {
+    std::string text;
+    object_ptr script;
+  };
+
+  struct hash
+  {
+    std::size_t operator()(boost::core::string_view sv) const
+    {
+      return std::hash<std::string_view>{}(std::string_view{sv.data(), sv.size()});
+    }
+  };
+
+  std::size_t capacity = 256u;
+  std::size_t hits = 0u, misses = 0u;
+
+  // most recently used at the front, the keys point into the text of the entries.
+  std::list<entry> entries;
+  boost::unordered_map<boost::core::string_view, std::list<entry>::iterator, hash> index;
+
+  object_ptr get(boost::core::string_view text)
+  {
+    auto itr = index.find(text);
+    if (itr != index.end())
+    {
+      hits++;
+      entries.splice(entries.begin(), entries, itr->second);
+      return itr->second->script;
+    }
+    misses++;
+    if (capacity == 0u)
+      return Tcl_NewStringObj(text.data(), text.size());
+
+    while (entries.size() >= capacity)
+      evict();
+
+    entries.push_front(entry{std::string(text), nullptr});
+    auto & e = entries.front();
+    e.script = Tcl_NewStringObj(e.text.data(), e.text.size());
+    index.emplace(boost::core::string_view{e.text}, entries.begin());
+    return e.script;
+  }
+
+  void evict()
+  {
+    index.erase(boost::core::string_view{entries.back().text});
+    entries.pop_back();
+  }
+
+  void resize(std::size_t cap)
+  {
+    capacity = cap;
+    while (entries.size() > capacity)
+      evict();
+  }
+};
+
+inline script_cache & get_script_cache(Tcl_Interp * interp)
+{
+  constexpr char key[] = "metal::tcl::script_cache";
+  auto p = static_cast<script_cache*>(Tcl_GetAssocData(interp, key, nullptr));
+  if (p == nullptr)
+  {
+    p = new script_cache();
+    Tcl_SetAssocData(interp, key,
+                     +[](ClientData clientData, Tcl_Interp *)
+                     {
+                       delete static_cast<script_cache*>(clientData);
+                     }, p);
+  }
+  return *p;
+}
+
+inline int eval_cached(Tcl_Interp * interp, boost::core::string_view script, int flags)
+{
+  if ((flags & TCL_EVAL_DIRECT) != 0)
+    return Tcl_EvalEx(interp, script.data(), script.size(), flags);
+
+  // holds a reference, in case the script gets evicted by a nested eval.
+  object_ptr obj = get_script_cache(interp).get(script);
+  return Tcl_EvalObjEx(interp, obj.get(), flags);
+}
+
+}
+
+/// Get the hit rate & size of the script cache of `interp`.
+inline script_cache_stats get_script_cache_stats(Tcl_Interp * interp)
+{
+  auto & cache = detail::get_script_cache(interp);
+  return script_cache_stats{cache.hits, cache.misses, cache.entries.size(), cache.capacity};
+}
+
+inline script_cache_stats get_script_cache_stats(const interpreter_ptr & interp)
+{
+  return get_script_cache_stats(interp.get());
+}
+
+/// Set the maximum number of cached scripts, 0 disables the cache.
+inline void set_script_cache_capacity(Tcl_Interp * interp, std::size_t capacity)
+{
+  detail::get_script_cache(interp).resize(capacity);
+}
+
+inline void set_script_cache_capacity(const interpreter_ptr & interp, std::size_t capacity)
+{
+  set_script_cache_capacity(interp.get(), capacity);
+}
+
 
 template<typename T = object_ptr>
 result<T> eval(Tcl_Interp * interp,
                boost::core::string_view script,
                int flags = 0)
 {
-  auto res = Tcl_EvalEx(interp, script.data(), script.size(), flags);
+  auto res = detail::eval_cached(interp, script, flags);
   if (res != TCL_OK)
     return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
@@ -98,11 +235,216 @@ result<T> eval_file(const interpreter_ptr & interp,
 }
 
 
+namespace detail
+{
+
+// compiled files of an interpreter, keyed by path & validated by the file stamp or the content hash.
+struct file_cache
+{
+  struct entry
+  {
+    file_stamp stamp;
+    std::uint64_t hash = 0u;
+    object_ptr script;
+  };
+  boost::unordered_map<std::string, entry> entries;
+};
+
+inline file_cache & get_file_cache(Tcl_Interp * interp)
+{
+  constexpr char key[] = "metal::tcl::file_cache";
+  auto p = static_cast<file_cache*>(Tcl_GetAssocData(interp, key, nullptr));
+  if (p == nullptr)
+  {
+    p = new file_cache();
+    Tcl_SetAssocData(interp, key,
+                     +[](ClientData clientData, Tcl_Interp *)
+                     {
+                       delete static_cast<file_cache*>(clientData);
+                     }, p);
+  }
+  return *p;
+}
+
+// `info script ?path?`
+inline int info_script(Tcl_Interp * interp, Tcl_Obj * path = nullptr)
+{
+  object_ptr info   = Tcl_NewStringObj("::info", -1),
+             script = Tcl_NewStringObj("script", -1);
+  Tcl_Obj * objv[3] = {info.get(), script.get(), path};
+  return Tcl_EvalObjv(interp, path ? 3 : 2, objv, TCL_EVAL_GLOBAL);
+}
+
+inline int eval_mapped_file(Tcl_Interp * interp, const char * path, bool use_cache)
+{
+  const auto fail =
+      [&](const boost::system::error_code & ec)
+      {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't read file \"%s\": %s", path, ec.message().c_str()));
+        return TCL_ERROR;
+      };
+
+  // like Tcl_EvalFile, ^Z terminates the script
+  const auto trim =
+      [](boost::core::string_view sv)
+      {
+        auto pos = sv.find('\x1a');
+        return pos == boost::core::string_view::npos ? sv : sv.substr(0, pos);
+      };
+
+  boost::system::error_code ec;
+  mapped_file mf;
+  object_ptr script;
+
+  if (use_cache)
+  {
+    auto & cache = get_file_cache(interp);
+    const auto stamp = stat_file(path, ec);
+    if (ec)
+    {
+      cache.entries.erase(path);
+      return fail(ec);
+    }
+
+    auto & e = cache.entries[path];
+    if (!e.script || e.stamp != stamp)
+    {
+      mf.open(path, ec);
+      if (ec)
+      {
+        cache.entries.erase(path);
+        return fail(ec);
+      }
+      const auto content = trim(mf.content());
+      const auto hash = hash_content(content);
+      // touched, but not modified: keep the compiled script
+      if (!e.script || e.hash != hash)
+      {
+        e.script = Tcl_NewStringObj(content.data(), content.size());
+        e.hash = hash;
+      }
+      e.stamp = mf.stamp();
+    }
+    script = e.script;
+  }
+  else
+  {
+    mf.open(path, ec);
+    if (ec)
+      return fail(ec);
+  }
+
+  if (info_script(interp) != TCL_OK)
+    return TCL_ERROR;
+  object_ptr previous = Tcl_GetObjResult(interp);
+  object_ptr path_obj = Tcl_NewStringObj(path, -1);
+  if (info_script(interp, path_obj.get()) != TCL_OK)
+    return TCL_ERROR;
+  Tcl_ResetResult(interp);
+
+  int res;
+  if (script)
+    res = Tcl_EvalObjEx(interp, script.get(), 0);
+  else
+  {
+    // evaluates directly from the mapping, without a copy
+    const auto content = trim(mf.content());
+    res = Tcl_EvalEx(interp, content.data(), content.size(), 0);
+  }
+
+  // a `return` at the top-level of the file ends it like a proc, so `return -code error` is an error.
+  if (res == TCL_RETURN)
+  {
+    object_ptr options = Tcl_GetReturnOptions(interp, res);
+    object_ptr level_key = Tcl_NewStringObj("-level", -1);
+    Tcl_Obj * level_obj = nullptr;
+    int level = 1;
+    if (Tcl_DictObjGet(nullptr, options.get(), level_key.get(), &level_obj) == TCL_OK && level_obj != nullptr)
+      Tcl_GetIntFromObj(nullptr, level_obj, &level);
+    // what the caller would see, i.e. the code once the level reaches 0
+    Tcl_DictObjPut(nullptr, options.get(), level_key.get(), Tcl_NewIntObj(level - 1));
+    res = Tcl_SetReturnOptions(interp, options.get());
+  }
+  if (res == TCL_ERROR)
+    Tcl_AppendObjToErrorInfo(interp, Tcl_ObjPrintf("\n    (file \"%s\" line %d)", path, Tcl_GetErrorLine(interp)));
+
+  auto state = Tcl_SaveInterpState(interp, res);
+  info_script(interp, previous.get());
+  return Tcl_RestoreInterpState(interp, state);
+}
+
+}
+
+/** Evaluate a file from a memory mapping instead of reading it through a channel.
+ *
+ * With `cache`, the compiled script is kept in the interpreter, so sourcing the same file again skips
+ * reading and compiling it unless its modification time or size changed.
+ * Without it, the script gets evaluated directly from the mapping.
+ *
+ * The file is expected to be utf-8 encoded.
+ */
+template<typename T = object_ptr>
+result<T> eval_mapped_file(Tcl_Interp * interp,
+                           const char * file,
+                           bool cache = true)
+{
+  auto res = detail::eval_mapped_file(interp, file, cache);
+  if (res != TCL_OK)
+    return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
+  return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
+}
+
+template<typename T = object_ptr>
+result<T> eval_mapped_file(Tcl_Interp * interp,
+                           const std::string & file,
+                           bool cache = true)
+{
+  return eval_mapped_file<T>(interp, file.c_str(), cache);
+}
+
+template<typename T = object_ptr>
+result<T> eval_mapped_file(const interpreter_ptr & interp,
+                           const char * file,
+                           bool cache = true)
+{
+  return eval_mapped_file<T>(interp.get(), file, cache);
+}
+
+template<typename T = object_ptr>
+result<T> eval_mapped_file(const interpreter_ptr & interp,
+                           const std::string & file,
+                           bool cache = true)
+{
+  return eval_mapped_file<T>(interp.get(), file.c_str(), cache);
+}
+
+/// Drop all compiled files of `interp`.
+inline void clear_file_cache(Tcl_Interp * interp)
+{
+  detail::get_file_cache(interp).entries.clear();
+}
+
+inline void clear_file_cache(const interpreter_ptr & interp)
+{
+  clear_file_cache(interp.get());
+}
+
+
 template<typename T = object_ptr>
 result<T> global_eval(Tcl_Interp * interp,
                       const char * script)
 {
-  auto res = Tcl_GlobalEval(interp, script);
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
+  if (res != TCL_OK)
+    return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
+  return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
+}
+
+template<typename T = object_ptr>
+result<T> global_eval(Tcl_Interp * interp,
+                      boost::core::string_view script)
+{
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
   if (res != TCL_OK)
     return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
@@ -120,7 +462,7 @@ template<typename T = object_ptr>
 result<T> global_eval(Tcl_Interp * interp,
                       const std::string & script)
 {
-  auto res = Tcl_GlobalEval(interp, script.c_str());
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
   if (res != TCL_OK)
     return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
@@ -140,7 +482,7 @@ result<void> eval<void>(Tcl_Interp * interp,
                         boost::core::string_view script,
                         int flags)
 {
-  auto res = Tcl_EvalEx(interp, script.data(), script.size(), flags);
+  auto res = detail::eval_cached(interp, script, flags);
   if (res != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<void>{boost::system::in_place_value};
@@ -181,12 +523,35 @@ result<void> eval_file(Tcl_Interp * interp,
   return result<void>{boost::system::in_place_value};
 }
 
+template<>
+inline
+result<void> eval_mapped_file(Tcl_Interp * interp,
+                              const char * file,
+                              bool cache)
+{
+  auto res = detail::eval_mapped_file(interp, file, cache);
+  if (res != TCL_OK)
+    return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
+  return result<void>{boost::system::in_place_value};
+}
+
 template<>
 inline
 result<void> global_eval(Tcl_Interp * interp,
                          const char * script)
 {
-  auto res = Tcl_GlobalEval(interp, script);
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
+  if (res != TCL_OK)
+    return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
+  return result<void>{boost::system::in_place_value};
+}
+
+template<>
+inline
+result<void> global_eval(Tcl_Interp * interp,
+                         boost::core::string_view script)
+{
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
   if (res != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<void>{boost::system::in_place_value};
@@ -197,7 +562,7 @@ inline
 result<void> global_eval(Tcl_Interp * interp,
                          const std::string & script)
 {
-  auto res = Tcl_GlobalEval(interp, script.c_str());
+  auto res = detail::eval_cached(interp, script, TCL_EVAL_GLOBAL);
   if (res != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};;
   return result<void>{boost::system::in_place_value};
@@ -13,9 +13,16 @@
 #include <metal/tcl/interpreter.hpp>
 #include <metal/tcl/object.hpp>
 #include <metal/tcl/exception.hpp>
+#include <metal/tcl/parse.hpp>
 
+#include <boost/core/detail/string_view.hpp>
 #include <boost/system/result.hpp>
 
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 namespace metal::tcl
 {
 
@@ -25,12 +32,14 @@ result<T> expr(Tcl_Interp * interp,
        U && value)
 {
   Tcl_Obj * objOut = nullptr;
-  auto res = Tcl_ExprObj(interp, make_object(interp, std::forward<U>(value)).detach(), &objOut);
+  object_ptr ex = make_object(interp, std::forward<U>(value));
+  auto res = Tcl_ExprObj(interp, ex.get(), &objOut);
 
   if (res != TCL_OK)
     return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
 
-  return result<T>{boost::system::in_place_value, cast<T>(interp, boost::intrusive_ptr<Tcl_Obj>{objOut})};
+  // objOut already has a reference for us
+  return result<T>{boost::system::in_place_value, cast<T>(interp, object_ptr{objOut, false})};
 }
 
 
@@ -42,6 +51,186 @@ result<T> expr(const interpreter_ptr & interp,
   return expr<T>(interp.get(), std::forward<U>(value));
 }
 
+
+/** An expression that gets compiled once & can be evaluated repeatedly with different variable values.
+ *
+ * Variables are either bound to a C++ object by reference, which gets read on every evaluation,
+ * or set through `set`. Numeric values get written into the existing Tcl objects, so evaluating
+ * doesn't involve any string conversions.
+ *
+ * Any other variable refers to the scope `evaluate` gets called from, like with `expr`, whether
+ * variables got declared or not. That doesn't include variables used inside command substitutions.
+ *
+ * @code
+ * double x = 0.;
+ * tcl::compiled_expr ex{interp, "$x * $y + 1"};
+ * ex.bind("x", x);
+ * const auto y = ex.declare("y");
+ *
+ * for (x = 0.; x < 10.; x++)
+ * {
+ *   ex.set(y, x / 2);
+ *   double d = ex.evaluate<double>().value();
+ * }
+ * @endcode
+ */
+struct compiled_expr
+{
+  compiled_expr(Tcl_Interp * interp, boost::core::string_view expression)
+      : interp_(interp), expression_(Tcl_NewStringObj(expression.data(), expression.size()))
+  {
+  }
+
+  compiled_expr(const interpreter_ptr & interp, boost::core::string_view expression)
+      : compiled_expr(interp.get(), expression)
+  {
+  }
+
+  compiled_expr(const compiled_expr & ) = delete;
+  compiled_expr & operator=(const compiled_expr & ) = delete;
+
+  /// Declare a variable to be set with `set`, returns the index of the variable.
+  std::size_t declare(boost::core::string_view name)
+  {
+    for (std::size_t i = 0u; i < vars_.size(); i++)
+      if (vars_[i].name == name)
+        return i;
+
+    vars_.push_back(variable{std::string(name), nullptr, nullptr, nullptr});
+    lambda_.reset();
+    return vars_.size() - 1u;
+  }
+
+  /// Bind a C++ variable, that will be read whenever the expression gets evaluated.
+  template<typename T>
+  std::size_t bind(boost::core::string_view name, const T & ref)
+  {
+    const auto idx = declare(name);
+    vars_[idx].ref = &ref;
+    vars_[idx].update =
+        +[](Tcl_Interp * interp, const void * ref, object_ptr & value)
+        {
+          detail::assign(interp, value, *static_cast<const T*>(ref));
+        };
+    return idx;
+  }
+
+  /// Set the value of a variable.
+  template<typename T>
+  void set(std::size_t idx, const T & value)
+  {
+    detail::assign(interp_, vars_.at(idx).value, value);
+  }
+
+  template<typename T>
+  void set(boost::core::string_view name, const T & value)
+  {
+    set(declare(name), value);
+  }
+
+  template<typename T = object_ptr>
+  result<T> evaluate()
+  {
+    int res;
+    if (vars_.empty())
+    {
+      // the expression object caches its bytecode
+      Tcl_Obj * out = nullptr;
+      res = Tcl_ExprObj(interp_, expression_.get(), &out);
+      if (res == TCL_OK)
+        Tcl_SetObjResult(interp_, out);
+      if (out)
+        Tcl_DecrRefCount(out);
+    }
+    else
+    {
+      if (!lambda_)
+        compile_();
+
+      for (std::size_t i = 0u; i < vars_.size(); i++)
+      {
+        auto & var = vars_[i];
+        if (var.update)
+          var.update(interp_, var.ref, var.value);
+        if (!var.value)
+          var.value = Tcl_NewObj();
+        objv_[i + 2u] = var.value.get();
+      }
+      res = Tcl_EvalObjv(interp_, static_cast<int>(objv_.size()), objv_.data(), 0);
+    }
+
+    if (res != TCL_OK)
+      return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp_)};
+    return result<T>{boost::system::in_place_value, cast<T>(interp_, Tcl_GetObjResult(interp_))};
+  }
+
+  Tcl_Interp * interpreter() const {return interp_;}
+
+ private:
+  struct variable
+  {
+    std::string name;
+    object_ptr value;
+    const void * ref;
+    void (*update)(Tcl_Interp * interp, const void * ref, object_ptr & value);
+  };
+
+  // builds `apply {{names...} {upvar 1 other other...; expr {expression}}}`, the lambda keeps the compiled body.
+  void compile_()
+  {
+    object_ptr params = Tcl_NewListObj(0, nullptr);
+    for (auto & var : vars_)
+      Tcl_ListObjAppendElement(interp_, params.get(), Tcl_NewStringObj(var.name.data(), var.name.size()));
+
+    // the other variables get linked to the caller's, so they resolve as they would without the lambda
+    object_ptr upvar = Tcl_NewListObj(0, nullptr);
+    std::vector<boost::core::string_view> linked;
+    parse_result pr;
+    auto st = Tcl_SaveInterpState(interp_, TCL_OK);
+    int len = 0;
+    const char * ex = Tcl_GetStringFromObj(expression_.get(), &len);
+    if (parse_expr(interp_, pr, boost::core::string_view(ex, static_cast<std::size_t>(len))))
+      for (auto & tk : pr.tokens())
+      {
+        if (tk.type != TCL_TOKEN_VARIABLE)
+          continue;
+        const boost::core::string_view name{(&tk)[1].start, static_cast<std::size_t>((&tk)[1].size)};
+        // qualified names don't depend on the scope
+        if (name.find("::") != boost::core::string_view::npos
+            || std::find(linked.begin(), linked.end(), name) != linked.end()
+            || std::any_of(vars_.begin(), vars_.end(), [&](const variable & v) {return v.name == name;}))
+          continue;
+        linked.push_back(name);
+        for (int i = 0; i < 2; i++)
+          Tcl_ListObjAppendElement(interp_, upvar.get(), Tcl_NewStringObj(name.data(), static_cast<int>(name.size())));
+      }
+    Tcl_RestoreInterpState(interp_, st);
+
+    Tcl_Obj * expr_cmd[2] = {Tcl_NewStringObj("expr", 4), expression_.get()};
+    object_ptr body = Tcl_NewListObj(2, expr_cmd);
+    if (!linked.empty())
+    {
+      object_ptr prefix = Tcl_NewStringObj("upvar 1 ", -1);
+      Tcl_AppendObjToObj(prefix.get(), upvar.get());
+      Tcl_AppendToObj(prefix.get(), "\n", 1);
+      Tcl_AppendObjToObj(prefix.get(), body.get());
+      body = prefix;
+    }
+    Tcl_Obj * lambda[2] = {params.get(), body.get()};
+
+    lambda_ = Tcl_NewListObj(2, lambda);
+    apply_ = Tcl_NewStringObj("::apply", -1);
+    objv_.assign(vars_.size() + 2u, nullptr);
+    objv_[0] = apply_.get();
+    objv_[1] = lambda_.get();
+  }
+
+  Tcl_Interp * interp_;
+  object_ptr expression_, apply_, lambda_;
+  std::vector<variable> vars_;
+  std::vector<Tcl_Obj*> objv_;
+};
+
 }
 
 #endif //METAL_TCL_EXPR_HPP
@@ -0,0 +1,313 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_FCOPY_HPP
+#define METAL_TCL_FCOPY_HPP
+
+#include <tcl.h>
+#include <metal/tcl/command.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// the fd of a channel, if its driver has a getHandleProc & nothing is stacked on top of it.
+inline bool channel_fd(Tcl_Channel chan, int direction, int & fd)
+{
+  if (Tcl_GetStackedChannel(Tcl_GetTopChannel(chan)) != nullptr)
+    return false;
+  ClientData handle = nullptr;
+  if (Tcl_GetChannelHandle(chan, direction, &handle) != TCL_OK)
+    return false;
+  fd = static_cast<int>(reinterpret_cast<std::intptr_t>(handle));
+  return true;
+}
+
+// true if the channel passes bytes through unchanged, i.e. binary encoding, lf translation & no eof char.
+inline bool channel_is_raw(Tcl_Channel chan)
+{
+  auto option = [&](const char * name, auto && pred)
+  {
+    Tcl_DString ds;
+    Tcl_DStringInit(&ds);
+    bool res = false;
+    int argc = 0;
+    const char ** argv = nullptr;
+    if (Tcl_GetChannelOption(nullptr, chan, name, &ds) == TCL_OK
+        && Tcl_SplitList(nullptr, Tcl_DStringValue(&ds), &argc, &argv) == TCL_OK)
+    {
+      res = std::all_of(argv, argv + argc, pred);
+      Tcl_Free(reinterpret_cast<char*>(argv));
+    }
+    Tcl_DStringFree(&ds);
+    return res;
+  };
+
+  return option("-encoding",    [](boost::core::string_view v) {return v == "binary";})
+      && option("-translation", [](boost::core::string_view v) {return v == "lf";})
+      && option("-eofchar",     [](boost::core::string_view v) {return v.empty();});
+}
+
+// sets both channels to blocking mode for the duration of the copy
+struct blocking_guard
+{
+  Tcl_Channel chans[2];
+  bool restore[2] = {false, false};
+
+  blocking_guard(Tcl_Channel in, Tcl_Channel out) : chans{in, out}
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      Tcl_DString ds;
+      Tcl_DStringInit(&ds);
+      if (Tcl_GetChannelOption(nullptr, chans[i], "-blocking", &ds) == TCL_OK
+          && boost::core::string_view(Tcl_DStringValue(&ds)) == "0")
+        restore[i] = Tcl_SetChannelOption(nullptr, chans[i], "-blocking", "1") == TCL_OK;
+      Tcl_DStringFree(&ds);
+      if (chans[0] == chans[1])
+        break;
+    }
+  }
+
+  ~blocking_guard()
+  {
+    for (int i = 0; i < 2; i++)
+      if (restore[i])
+        Tcl_SetChannelOption(nullptr, chans[i], "-blocking", "0");
+  }
+};
+
+#if defined(__linux__)
+
+// copies in the kernel. returns the number of bytes copied, or -1 and sets errno.
+inline Tcl_WideInt kernel_copy(int in, int out, Tcl_WideInt size)
+{
+  struct stat st_in, st_out;
+  if (fstat(in, &st_in) != 0 || fstat(out, &st_out) != 0)
+    return -1;
+
+  constexpr std::size_t chunk = 1024u * 1024u;
+  auto next = [&](Tcl_WideInt done)
+  {
+    return size < 0 ? chunk : static_cast<std::size_t>((std::min)(static_cast<Tcl_WideInt>(chunk), size - done));
+  };
+
+  Tcl_WideInt done = 0;
+
+  // sockets get spliced to sockets through a pipe
+  struct pipe_t
+  {
+    int fds[2] = {-1, -1};
+    ~pipe_t()
+    {
+      if (fds[0] >= 0)
+      {
+        ::close(fds[0]);
+        ::close(fds[1]);
+      }
+    }
+  } pipe;
+  std::size_t in_pipe = 0u;
+  constexpr unsigned int flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+
+  bool use_copy_file_range = S_ISREG(st_in.st_mode) && S_ISREG(st_out.st_mode);
+  while (size < 0 || done < size)
+  {
+    ssize_t n = -1;
+    if (use_copy_file_range)
+    {
+      n = copy_file_range(in, nullptr, out, nullptr, next(done), 0u);
+      // e.g. across file systems on older kernels
+      if (n < 0 && done == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+      {
+        use_copy_file_range = false;
+        continue;
+      }
+    }
+    else if (S_ISREG(st_in.st_mode))
+      n = sendfile(out, in, nullptr, next(done));
+    else if (S_ISFIFO(st_in.st_mode) || S_ISFIFO(st_out.st_mode))
+      n = splice(in, nullptr, out, nullptr, next(done), flags);
+    else
+    {
+      if (pipe.fds[0] < 0 && pipe2(pipe.fds, O_CLOEXEC) != 0)
+        return -1;
+      n = in_pipe > 0u ? static_cast<ssize_t>(in_pipe) : splice(in, nullptr, pipe.fds[1], nullptr, next(done), flags);
+      if (n > 0)
+      {
+        in_pipe = static_cast<std::size_t>(n);
+        n = splice(pipe.fds[0], nullptr, out, nullptr, in_pipe, flags);
+        if (n > 0)
+          in_pipe -= static_cast<std::size_t>(n);
+      }
+    }
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0) // eof
+      break;
+    done += n;
+  }
+  return done;
+}
+
+#endif
+
+}
+
+/** True if `copy_channel` can copy between the channels without passing the data through user space.
+ *
+ * That requires both channels to be backed by file descriptors, i.e. to provide a `get_handle`,
+ * not to have transforms stacked on them & to be configured to pass data through unchanged,
+ * e.g. by `fconfigure chan -translation binary`. Files opened for appending go through tcl's buffers.
+ * Only available on linux.
+ */
+inline bool kernel_copy_possible(Tcl_Channel in, Tcl_Channel out)
+{
+#if defined(__linux__)
+  int fd_in = -1, fd_out = -1;
+  return detail::channel_fd(in, TCL_READABLE, fd_in) && detail::channel_fd(out, TCL_WRITABLE, fd_out)
+      // copy_file_range & sendfile don't support appending
+      && (fcntl(fd_out, F_GETFL) & O_APPEND) == 0
+      && detail::channel_is_raw(in) && detail::channel_is_raw(out);
+#else
+  return false;
+#endif
+}
+
+/** Copy up to size characters, or everything if size is negative, from in to out, like a synchronous `fcopy`.
+ *
+ * If `kernel_copy_possible`, the data gets moved by `copy_file_range`, `sendfile` or `splice`, after whatever
+ * tcl already buffered. Otherwise the channels' encodings & translations get applied just like `fcopy` does.
+ * Non-blocking channels are switched to blocking mode during the copy. Note that tcl doesn't see data
+ * copied in the kernel, so `eof in` only becomes true with the next read.
+ *
+ * Returns the number of characters copied.
+ */
+inline result<Tcl_WideInt> copy_channel(Tcl_Interp * interp, Tcl_Channel in, Tcl_Channel out, Tcl_WideInt size = -1)
+{
+  detail::blocking_guard guard{in, out};
+  // chan is null if it's not known which side failed
+  auto error = [&](Tcl_Channel chan)
+  {
+    if (chan == nullptr)
+      Tcl_SetObjResult(interp, Tcl_ObjPrintf("error copying from \"%s\" to \"%s\": %s",
+                                             Tcl_GetChannelName(in), Tcl_GetChannelName(out), Tcl_PosixError(interp)));
+    else
+      Tcl_SetObjResult(interp, Tcl_ObjPrintf("error %s \"%s\": %s", chan == in ? "reading" : "writing",
+                                             Tcl_GetChannelName(chan), Tcl_PosixError(interp)));
+    return result<Tcl_WideInt>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
+  };
+
+  Tcl_WideInt done = 0;
+  const bool raw = kernel_copy_possible(in, out);
+  object_ptr buffer{Tcl_NewObj()};
+
+  // whatever tcl already buffered goes first, so the order is preserved
+  const Tcl_WideInt buffered = raw ? Tcl_InputBuffered(in) : 0;
+  while ((size < 0 || done < size) && (!raw || done < buffered))
+  {
+    const Tcl_WideInt chunk = raw ? buffered - done : 64 * 1024;
+    const int n = Tcl_ReadChars(in, buffer.get(), static_cast<int>(size < 0 ? chunk : (std::min)(chunk, size - done)), 0);
+    if (n < 0)
+      return error(in);
+    if (n == 0)
+      break;
+    if (Tcl_WriteObj(out, buffer.get()) < 0)
+      return error(out);
+    done += n;
+  }
+
+#if defined(__linux__)
+  if (raw && (size < 0 || done < size) && !Tcl_Eof(in))
+  {
+    if (Tcl_Flush(out) != TCL_OK)
+      return error(out);
+    int fd_in = -1, fd_out = -1;
+    detail::channel_fd(in, TCL_READABLE, fd_in);
+    detail::channel_fd(out, TCL_WRITABLE, fd_out);
+    const auto n = detail::kernel_copy(fd_in, fd_out, size < 0 ? -1 : size - done);
+    if (n < 0)
+      return error(nullptr);
+    done += n;
+  }
+#endif
+
+  return result<Tcl_WideInt>{boost::system::in_place_value, done};
+}
+
+inline result<Tcl_WideInt> copy_channel(const interpreter_ptr & interp, Tcl_Channel in, Tcl_Channel out, Tcl_WideInt size = -1)
+{
+  return copy_channel(interp.get(), in, out, size);
+}
+
+/** Create a command `name in out ?-size size?` that copies with `copy_channel` & returns the number of characters copied.
+ *
+ * @code
+ * tcl::create_fcopy_command(interp);
+ * tcl::eval(interp, "fconfigure $f -translation binary; fconfigure $sock -translation binary; metal::fcopy $f $sock");
+ * @endcode
+ */
+inline command & create_fcopy_command(Tcl_Interp * interp, const char * name = "metal::fcopy")
+{
+  auto copy = [interp](object_ptr in, object_ptr out, Tcl_WideInt size) -> object_ptr
+  {
+    auto ci = Tcl_GetChannel(interp, Tcl_GetString(in.get()), nullptr);
+    auto co = ci ? Tcl_GetChannel(interp, Tcl_GetString(out.get()), nullptr) : nullptr;
+    if (co == nullptr)
+      throw_result(interp);
+    auto res = copy_channel(interp, ci, co, size);
+    if (res.has_error())
+      throw_result(interp);
+    return Tcl_NewWideIntObj(*res);
+  };
+
+  auto & cmd = create_command(interp, name);
+  cmd.add_function([copy](object_ptr in, object_ptr out) {return copy(in, out, -1);})
+     .add_function(
+         [copy, interp](object_ptr in, object_ptr out, object_ptr opt, object_ptr size)
+         {
+           Tcl_WideInt sz = -1;
+           if (boost::core::string_view(Tcl_GetString(opt.get())) != "-size")
+             throw std::invalid_argument("bad option \"" + std::string(Tcl_GetString(opt.get())) + "\": must be -size");
+           if (Tcl_GetWideIntFromObj(interp, size.get(), &sz) != TCL_OK)
+             throw_result(interp);
+           return copy(in, out, sz);
+         });
+  return cmd;
+}
+
+inline command & create_fcopy_command(const interpreter_ptr & interp, const char * name = "metal::fcopy")
+{
+  return create_fcopy_command(interp.get(), name);
+}
+
+}
+
+#endif //METAL_TCL_FCOPY_HPP
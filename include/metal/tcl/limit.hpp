@@ -0,0 +1,301 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_LIMIT_HPP
+#define METAL_TCL_LIMIT_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+#include <boost/system/result.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+struct canceller_access;
+}
+
+/** Cancels the limited evaluations of an interpreter, from any thread.
+ *
+ * Cancelling unwinds the whole evaluation, i.e. the script can't `catch` it.
+ * It only affects evaluations that are running, a cancel with no evaluation running is a no-op.
+ */
+struct eval_canceller
+{
+  explicit eval_canceller(Tcl_Interp * interp) : interp_(interp) {}
+  explicit eval_canceller(const interpreter_ptr & interp) : eval_canceller(interp.get()) {}
+
+  eval_canceller(const eval_canceller & ) = delete;
+  eval_canceller& operator=(const eval_canceller & ) = delete;
+
+  /// Cancel the running evaluation, returns false if there was none.
+  bool cancel()
+  {
+    std::lock_guard<std::mutex> lock{mtx_};
+    if (!active_)
+      return false;
+    canceled_ = true;
+    return Tcl_CancelEval(interp_, nullptr, nullptr, TCL_CANCEL_UNWIND) == TCL_OK;
+  }
+
+ private:
+  friend struct detail::canceller_access;
+
+  // returns if the evaluation got canceled
+  bool set_active_(bool active)
+  {
+    std::lock_guard<std::mutex> lock{mtx_};
+    active_ = active;
+    return std::exchange(canceled_, false);
+  }
+
+  Tcl_Interp * interp_;
+  std::mutex mtx_;
+  bool active_ = false;
+  bool canceled_ = false;
+};
+
+/** Budgets for a single evaluation.
+ *
+ * Tcl doesn't account memory per interpreter, so the memory budget is checked with `memory_probe`,
+ * e.g. a function returning the heap size of the process, every `memory_check_interval` commands.
+ */
+struct eval_limits
+{
+  /// Maximum number of commands the script may execute.
+  std::optional<long> commands;
+  /// Maximum wall-clock time, checked every `time_granularity` commands.
+  std::optional<std::chrono::steady_clock::duration> time;
+  int time_granularity = 10;
+
+  std::size_t memory = 0u;
+  std::function<std::size_t()> memory_probe;
+  long memory_check_interval = 1000;
+
+  eval_canceller * canceller = nullptr;
+};
+
+/// What an evaluation with `eval_limits` consumed.
+struct eval_usage
+{
+  long commands = 0;
+  std::chrono::steady_clock::duration time{};
+  std::size_t peak_memory = 0u;
+
+  bool commands_exceeded = false;
+  bool time_exceeded = false;
+  bool memory_exceeded = false;
+  bool canceled = false;
+};
+
+namespace detail
+{
+
+struct canceller_access
+{
+  static void activate(eval_canceller & c) {c.set_active_(true);}
+  static bool deactivate(eval_canceller & c) {return c.set_active_(false);}
+};
+
+inline long command_count(Tcl_Interp * interp)
+{
+  // the implementation of `info cmdcount`, so it works if `info` got replaced.
+  // a new object per call, because the resolved command gets cached in it & that's specific to one interpreter.
+  object_ptr cmd{Tcl_NewStringObj("::tcl::info::cmdcount", -1)};
+  Tcl_Obj * objv[1] = {cmd.get()};
+  auto st = Tcl_SaveInterpState(interp, TCL_OK);
+  long res = 0;
+  if (Tcl_EvalObjv(interp, 1, objv, TCL_EVAL_GLOBAL) == TCL_OK)
+    Tcl_GetLongFromObj(nullptr, Tcl_GetObjResult(interp), &res);
+  Tcl_RestoreInterpState(interp, st);
+  return res;
+}
+
+struct limit_state
+{
+  Tcl_Interp * interp;
+  const eval_limits & limits;
+  eval_usage & usage;
+  long command_end;
+
+  // the command limit is used for the memory checkpoints, so the next limit is whichever comes first.
+  void set_command_limit(long current)
+  {
+    long next = command_end;
+    if (limits.memory_probe)
+      next = (std::min)(next, current + limits.memory_check_interval);
+    Tcl_LimitSetCommands(interp, static_cast<int>((std::min)(next, static_cast<long>(INT_MAX))));
+    Tcl_LimitTypeSet(interp, TCL_LIMIT_COMMANDS);
+  }
+
+  static void handler(ClientData data, Tcl_Interp * interp)
+  {
+    auto & st = *static_cast<limit_state*>(data);
+    const long current = Tcl_LimitGetCommands(interp);
+
+    if (st.limits.memory_probe)
+    {
+      const auto mem = st.limits.memory_probe();
+      st.usage.peak_memory = (std::max)(st.usage.peak_memory, mem);
+      if (mem > st.limits.memory)
+      {
+        st.usage.memory_exceeded = true;
+        return;
+      }
+    }
+
+    if (current < st.command_end)
+      st.set_command_limit(current);
+  }
+};
+
+// restores the limits of the interpreter after the evaluation
+struct saved_limits
+{
+  Tcl_Interp * interp;
+  bool commands_enabled = Tcl_LimitTypeEnabled(interp, TCL_LIMIT_COMMANDS);
+  bool time_enabled     = Tcl_LimitTypeEnabled(interp, TCL_LIMIT_TIME);
+  int commands          = Tcl_LimitGetCommands(interp);
+  int granularity       = Tcl_LimitGetGranularity(interp, TCL_LIMIT_TIME);
+  Tcl_Time time         = get_time();
+
+  Tcl_Time get_time() const
+  {
+    Tcl_Time t;
+    Tcl_LimitGetTime(interp, &t);
+    return t;
+  }
+
+  ~saved_limits()
+  {
+    Tcl_LimitTypeReset(interp, TCL_LIMIT_COMMANDS);
+    Tcl_LimitTypeReset(interp, TCL_LIMIT_TIME);
+    Tcl_LimitSetCommands(interp, commands);
+    Tcl_LimitSetTime(interp, &time);
+    Tcl_LimitSetGranularity(interp, TCL_LIMIT_TIME, granularity);
+    if (commands_enabled)
+      Tcl_LimitTypeSet(interp, TCL_LIMIT_COMMANDS);
+    if (time_enabled)
+      Tcl_LimitTypeSet(interp, TCL_LIMIT_TIME);
+  }
+};
+
+}
+
+/** Evaluate a script within budgets.
+ *
+ * Exceeding a budget or being canceled makes the evaluation fail, but leaves the interpreter usable.
+ * The limits the interpreter had before are restored afterwards. Time & memory are only checked between commands,
+ * so a single long running command (e.g. `after 10000`) isn't interrupted.
+ *
+ * @code
+ * tcl::eval_limits limits;
+ * limits.commands = 100000;
+ * limits.time = std::chrono::milliseconds(50);
+ *
+ * tcl::eval_usage usage;
+ * auto res = tcl::eval(interp, untrusted_script, limits, &usage);
+ * @endcode
+ */
+template<typename T = object_ptr>
+result<T> eval(Tcl_Interp * interp, boost::core::string_view script,
+               const eval_limits & limits, eval_usage * usage = nullptr)
+{
+  eval_usage local_usage;
+  auto & us = usage ? *usage : local_usage;
+  us = eval_usage{};
+
+  int res;
+  const long start = detail::command_count(interp);
+  {
+    detail::saved_limits saved{interp};
+    const bool count_commands = limits.commands || limits.memory_probe;
+    const auto started = std::chrono::steady_clock::now();
+
+    detail::limit_state st{interp, limits, us, limits.commands ? start + *limits.commands : static_cast<long>(INT_MAX)};
+    if (count_commands)
+    {
+      Tcl_LimitAddHandler(interp, TCL_LIMIT_COMMANDS, &detail::limit_state::handler, &st, nullptr);
+      st.set_command_limit(start);
+    }
+
+    if (limits.time)
+    {
+      Tcl_Time now, end;
+      Tcl_GetTime(&now);
+      const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(*limits.time).count() + now.usec;
+      end.sec  = now.sec + static_cast<long>(micros / 1000000);
+      end.usec = static_cast<long>(micros % 1000000);
+      Tcl_LimitSetGranularity(interp, TCL_LIMIT_TIME, limits.time_granularity);
+      Tcl_LimitSetTime(interp, &end);
+      Tcl_LimitTypeSet(interp, TCL_LIMIT_TIME);
+    }
+
+    if (limits.canceller)
+      detail::canceller_access::activate(*limits.canceller);
+
+    res = detail::eval_cached(interp, script, 0);
+
+    if (limits.canceller)
+    {
+      us.canceled = detail::canceller_access::deactivate(*limits.canceller);
+      // a cancel that arrived as the script finished must not hit the next evaluation.
+      if (us.canceled)
+      {
+        while (Tcl_AsyncReady())
+          Tcl_AsyncInvoke(interp, TCL_OK);
+        Tcl_Canceled(interp, 0);
+      }
+    }
+
+    us.time = std::chrono::steady_clock::now() - started;
+    us.commands_exceeded = !us.memory_exceeded && Tcl_LimitTypeExceeded(interp, TCL_LIMIT_COMMANDS);
+    us.time_exceeded = Tcl_LimitTypeExceeded(interp, TCL_LIMIT_TIME);
+
+    if (count_commands)
+      Tcl_LimitRemoveHandler(interp, TCL_LIMIT_COMMANDS, &detail::limit_state::handler, &st);
+  }
+  // counted after the limits are restored, -1 for the evaluation of cmdcount itself
+  us.commands = detail::command_count(interp) - start - 1;
+
+  if (res != TCL_OK)
+  {
+    if (us.memory_exceeded)
+      Tcl_SetObjResult(interp, Tcl_NewStringObj("memory limit exceeded", -1));
+    return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
+  }
+
+  if constexpr (std::is_void_v<T>)
+    return result<void>{boost::system::in_place_value};
+  else
+    return result<T>{boost::system::in_place_value, cast<T>(interp, Tcl_GetObjResult(interp))};
+}
+
+template<typename T = object_ptr>
+result<T> eval(const interpreter_ptr & interp, boost::core::string_view script,
+               const eval_limits & limits, eval_usage * usage = nullptr)
+{
+  return eval<T>(interp.get(), script, limits, usage);
+}
+
+}
+
+#endif //METAL_TCL_LIMIT_HPP
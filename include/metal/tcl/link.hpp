@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_LINK_HPP
+#define METAL_TCL_LINK_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+template<typename T>
+struct link_value
+{
+  using type = T;
+  static T load(const T & t) {return t;}
+  static void store(T & t, T value) {t = std::move(value);}
+};
+
+template<typename T>
+struct link_value<std::atomic<T>>
+{
+  using type = T;
+  static T load(const std::atomic<T> & t) {return t.load();}
+  static void store(std::atomic<T> & t, T value) {t.store(value);}
+};
+
+// the TCL_LINK_* type of T, or -1 if it can't be linked by Tcl_LinkVar.
+template<typename T>
+constexpr int link_type()
+{
+  if constexpr (std::is_same_v<T, double>)
+    return TCL_LINK_DOUBLE;
+  else if constexpr (std::is_same_v<T, float>)
+    return TCL_LINK_FLOAT;
+  // TCL_LINK_BOOLEAN expects an int
+  else if constexpr (!std::is_integral_v<T> || std::is_same_v<T, bool>)
+    return -1;
+  else if constexpr (sizeof(T) == sizeof(char))
+    return std::is_signed_v<T> ? TCL_LINK_CHAR : TCL_LINK_UCHAR;
+  else if constexpr (sizeof(T) == sizeof(short))
+    return std::is_signed_v<T> ? TCL_LINK_SHORT : TCL_LINK_USHORT;
+  else if constexpr (sizeof(T) == sizeof(int))
+    return std::is_signed_v<T> ? TCL_LINK_INT : TCL_LINK_UINT;
+  else if constexpr (sizeof(T) == sizeof(Tcl_WideInt))
+    return std::is_signed_v<T> ? TCL_LINK_WIDE_INT : TCL_LINK_WIDE_UINT;
+  else
+    return -1;
+}
+
+}
+
+/** A C++ object linked to a global tcl variable.
+ *
+ * Numeric types are linked with `Tcl_LinkVar`, i.e. tcl reads & writes the C++ object directly
+ * and no C++ code runs on access. Everything else, i.e. `bool`, `std::string`, enums & `std::atomic<T>`,
+ * uses a trace that only converts the value when it changed since the variable was last read.
+ *
+ * Tcl only notices changes on the C++ side when the variable gets read, so write traces & `vwait`
+ * need an explicit `update()`.
+ */
+template<typename T>
+struct linked_var
+{
+  using value_type = typename detail::link_value<T>::type;
+  constexpr static bool native = detail::link_type<T>() >= 0;
+
+  linked_var(Tcl_Interp * interp, const char * name, T & ref, bool read_only = false)
+      : interp(interp), name(name), ref_(ref), read_only_(read_only)
+  {
+    if constexpr (native)
+    {
+      if (Tcl_LinkVar(interp, name, reinterpret_cast<char*>(&ref),
+                      detail::link_type<T>() | (read_only ? TCL_LINK_READ_ONLY : 0)) != TCL_OK)
+        throw_result(interp);
+    }
+    else
+    {
+      push_();
+      if (!trace_())
+        throw_result(interp);
+    }
+  }
+
+  linked_var(const interpreter_ptr & interp, const char * name, T & ref, bool read_only = false)
+      : linked_var(interp.get(), name, ref, read_only)
+  {
+  }
+
+  linked_var(const linked_var & ) = delete;
+
+  ~linked_var()
+  {
+    if constexpr (native)
+      Tcl_UnlinkVar(interp, name.c_str());
+    else if (traced_)
+      Tcl_UntraceVar2(interp, name.c_str(), nullptr, trace_flags, &trace_proc_, this);
+  }
+
+  /// Tell tcl that the C++ object changed, which fires the variable's write traces.
+  void update()
+  {
+    if constexpr (native)
+      Tcl_UpdateLinkedVar(interp, name.c_str());
+    else if (!last_ || !(*last_ == detail::link_value<T>::load(ref_)))
+    {
+      updating_ = true;
+      push_();
+      updating_ = false;
+    }
+  }
+
+  Tcl_Interp * const interp;
+  const std::string name;
+
+ private:
+  constexpr static int trace_flags = TCL_GLOBAL_ONLY | TCL_TRACE_READS | TCL_TRACE_WRITES | TCL_TRACE_UNSETS;
+
+  bool trace_()
+  {
+    traced_ = Tcl_TraceVar2(interp, name.c_str(), nullptr, trace_flags, &trace_proc_, this) == TCL_OK;
+    return traced_;
+  }
+
+  void push_()
+  {
+    auto value = detail::link_value<T>::load(ref_);
+    object_ptr obj = make_object(interp, value);
+    Tcl_SetVar2Ex(interp, name.c_str(), nullptr, obj.get(), TCL_GLOBAL_ONLY);
+    last_.emplace(std::move(value));
+  }
+
+  static char * trace_proc_(ClientData clientData, Tcl_Interp * interp, const char *, const char *, int flags)
+  {
+    auto & this_ = *static_cast<linked_var*>(clientData);
+    // traces are disabled while they run, so setting the variable here doesn't recurse.
+    if (flags & TCL_TRACE_READS)
+    {
+      if (!this_.last_ || !(*this_.last_ == detail::link_value<T>::load(this_.ref_)))
+        this_.push_();
+    }
+    else if (flags & TCL_TRACE_WRITES)
+    {
+      if (this_.updating_)
+        return nullptr;
+      if (this_.read_only_)
+      {
+        this_.push_();
+        return const_cast<char*>("linked variable is read-only");
+      }
+
+      std::optional<value_type> value;
+      if (auto p = Tcl_GetVar2Ex(interp, this_.name.c_str(), nullptr, TCL_GLOBAL_ONLY))
+        value = tag_invoke(cast_tag<value_type>{}, interp, object_ptr{p});
+      if (!value)
+      {
+        this_.push_();
+        return const_cast<char*>("invalid value for linked variable");
+      }
+      this_.last_ = *value;
+      detail::link_value<T>::store(this_.ref_, std::move(*value));
+    }
+    else if (flags & TCL_TRACE_UNSETS)
+    {
+      this_.traced_ = false;
+      // like Tcl_LinkVar, the variable gets re-created unless the interpreter goes away.
+      if ((flags & TCL_INTERP_DESTROYED) == 0 && (flags & TCL_TRACE_DESTROYED))
+      {
+        this_.push_();
+        this_.trace_();
+      }
+    }
+    return nullptr;
+  }
+
+  T & ref_;
+  const bool read_only_;
+  bool traced_ = false;
+  bool updating_ = false;
+  // the value the tcl variable was last set to.
+  std::optional<value_type> last_;
+};
+
+/** Link a C++ object to a global tcl variable, until the returned object gets destroyed.
+ *
+ * @code
+ * int rpm = 0;
+ * std::atomic<bool> running{false};
+ * auto l1 = tcl::link(interp, "motor::rpm", rpm);
+ * auto l2 = tcl::link(interp, "motor::running", running, true);
+ * @endcode
+ */
+template<typename T>
+linked_var<T> link(Tcl_Interp * interp, const char * name, T & ref, bool read_only = false)
+{
+  return linked_var<T>(interp, name, ref, read_only);
+}
+
+template<typename T>
+linked_var<T> link(const interpreter_ptr & interp, const char * name, T & ref, bool read_only = false)
+{
+  return linked_var<T>(interp.get(), name, ref, read_only);
+}
+
+}
+
+#endif //METAL_TCL_LINK_HPP
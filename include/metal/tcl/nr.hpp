@@ -0,0 +1,375 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_NR_HPP
+#define METAL_TCL_NR_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/command.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <boost/assert.hpp>
+
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// the interpreter whose non-recursive command is currently running on this thread.
+inline Tcl_Interp * & nr_interp()
+{
+  thread_local Tcl_Interp * interp = nullptr;
+  return interp;
+}
+
+}
+
+/** Create a command that runs in tcl's non-recursive engine.
+ *
+ * The functions are added like with `create_command`, but can use `nr_eval`, so the scripts they evaluate
+ * run on tcl's trampoline instead of nesting on the C stack. This allows them to be used with `yield`, `tailcall`
+ * and deep recursion. With C++20, functions can also be coroutines returning `nr_task`.
+ */
+inline command & create_nr_command(Tcl_Interp *interp, const char * name)
+{
+  auto cd = new command;
+  constexpr auto nre_proc =
+      +[](ClientData cdata, Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
+      {
+        auto & current = detail::nr_interp();
+        const auto prev = std::exchange(current, interp);
+        const auto res = static_cast<command*>(cdata)->invoke_(interp, objc, objv);
+        current = prev;
+        return res;
+      };
+
+  cd->cmd_ = Tcl_NRCreateCommand(interp, name,
+                                 +[](ClientData cdata, Tcl_Interp * interp, int objc, Tcl_Obj * const objv[])
+                                 {
+                                   return Tcl_NRCallObjProc(interp, nre_proc, cdata, objc, objv);
+                                 },
+                                 nre_proc, cd,
+                                 +[](ClientData cdata) { delete static_cast<command*>(cdata); });
+  return *cd;
+}
+
+inline command & create_nr_command(const interpreter_ptr & interp, const char * name)
+{
+  return create_nr_command(interp.get(), name);
+}
+
+/** Evaluate a script after the current non-recursive command returned.
+ *
+ * The result of the script replaces the result of the command, i.e. it works like `tailcall`.
+ * Can only be used from a function of a command created by `create_nr_command`.
+ */
+inline void nr_eval(Tcl_Interp * interp, object_ptr script, int flags = 0)
+{
+  BOOST_ASSERT(detail::nr_interp() == interp);
+  Tcl_NREvalObj(interp, script.get(), flags);
+}
+
+/** Evaluate a script after the current non-recursive command returned, and then invoke `continuation`.
+ *
+ * The continuation gets invoked as `int(Tcl_Interp*, int code)` with the result of the script in the interpreter,
+ * and returns the completion code of the command. It can call `nr_eval` again.
+ */
+template<typename Continuation>
+void nr_eval(Tcl_Interp * interp, object_ptr script, Continuation && continuation, int flags = 0)
+{
+  BOOST_ASSERT(detail::nr_interp() == interp);
+  using func_t = std::decay_t<Continuation>;
+  Tcl_NRAddCallback(interp,
+                    +[](ClientData data[], Tcl_Interp * interp, int code) -> int
+                    {
+                      std::unique_ptr<func_t> func{static_cast<func_t*>(data[0])};
+                      // the continuation may schedule more scripts
+                      auto & current = detail::nr_interp();
+                      const auto prev = std::exchange(current, interp);
+                      int res;
+                      try
+                      {
+                        res = (*func)(interp, code);
+                      }
+                      catch (...)
+                      {
+                        Tcl_SetObjResult(interp, make_exception_object().get());
+                        res = TCL_ERROR;
+                      }
+                      current = prev;
+                      return res;
+                    },
+                    new func_t(std::forward<Continuation>(continuation)), nullptr, nullptr, nullptr);
+  Tcl_NREvalObj(interp, script.get(), flags);
+}
+
+#if defined(__cpp_impl_coroutine)
+
+namespace detail
+{
+
+struct nr_promise_base
+{
+  std::coroutine_handle<> handle;
+  Tcl_Interp * interp = nullptr;
+  std::exception_ptr exception;
+
+  // result of the last awaited script
+  int code = TCL_OK;
+  object_ptr value;
+
+  std::suspend_always initial_suspend() noexcept {return {};}
+  std::suspend_always final_suspend() noexcept {return {};}
+  void unhandled_exception() {exception = std::current_exception();}
+
+  // sets the interpreter result of a finished coroutine.
+  virtual int complete() = 0;
+};
+
+}
+
+/** A coroutine implementing a non-recursive command.
+ *
+ * Functions returning an `nr_task` can be added to commands created with `create_nr_command`.
+ * Inside them, `co_await nr_eval(script)` evaluates a script on the trampoline & resumes with its result,
+ * and `co_await nr_yield(value)` yields from the enclosing tcl coroutine. The value passed to `co_return`
+ * becomes the result of the command.
+ *
+ * @code
+ * tcl::nr_task<int> count(int n)
+ * {
+ *   int sum = 0;
+ *   for (int i = 0; i < n; i++)
+ *     sum += tcl::cast<int>(interp, (co_await tcl::nr_yield(i)).value());
+ *   co_return sum;
+ * }
+ *
+ * tcl::create_nr_command(interp, "count").add_function(&count);
+ * @endcode
+ */
+template<typename T = void>
+struct nr_task
+{
+  struct promise_type : detail::nr_promise_base
+  {
+    std::optional<T> result;
+
+    nr_task get_return_object()
+    {
+      handle = std::coroutine_handle<promise_type>::from_promise(*this);
+      return nr_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    template<typename U = T>
+    void return_value(U && u) {result.emplace(std::forward<U>(u));}
+
+    int complete() override
+    {
+      Tcl_SetObjResult(interp, make_object(interp, std::move(*result)).get());
+      return TCL_OK;
+    }
+  };
+
+  nr_task(nr_task && lhs) noexcept : handle_(std::exchange(lhs.handle_, nullptr)) {}
+  ~nr_task()
+  {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  // takes ownership of the coroutine, which is destroyed once it's done.
+  detail::nr_promise_base * release()
+  {
+    return &std::exchange(handle_, nullptr).promise();
+  }
+
+ private:
+  explicit nr_task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template<>
+struct nr_task<void>
+{
+  struct promise_type : detail::nr_promise_base
+  {
+    nr_task get_return_object()
+    {
+      handle = std::coroutine_handle<promise_type>::from_promise(*this);
+      return nr_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    void return_void() {}
+
+    int complete() override
+    {
+      Tcl_ResetResult(interp);
+      return TCL_OK;
+    }
+  };
+
+  nr_task(nr_task && lhs) noexcept : handle_(std::exchange(lhs.handle_, nullptr)) {}
+  ~nr_task()
+  {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  detail::nr_promise_base * release()
+  {
+    return &std::exchange(handle_, nullptr).promise();
+  }
+
+ private:
+  explicit nr_task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail
+{
+
+// resumes the coroutine and destroys it if it's done, returns the completion code for the command.
+inline int nr_resume(nr_promise_base * promise, Tcl_Interp * interp)
+{
+  auto & p = *promise;
+  const auto handle = p.handle;
+  p.interp = interp;
+
+  auto & current = nr_interp();
+  const auto prev = std::exchange(current, interp);
+  handle.resume();
+  current = prev;
+
+  // suspended on a script, which will resume it.
+  if (!handle.done())
+    return TCL_OK;
+
+  int res;
+  if (p.exception)
+  {
+    Tcl_SetObjResult(interp, make_exception_object(p.exception).get());
+    res = TCL_ERROR;
+  }
+  else
+  {
+    try
+    {
+      res = p.complete();
+    }
+    catch (...)
+    {
+      Tcl_SetObjResult(interp, make_exception_object().get());
+      res = TCL_ERROR;
+    }
+  }
+  handle.destroy();
+  return res;
+}
+
+}
+
+/// Awaitable evaluating a script on the trampoline, resumes with the result of the script.
+struct nr_eval_awaitable
+{
+  object_ptr script;
+  int flags = 0;
+  detail::nr_promise_base * promise = nullptr;
+
+  bool await_ready() const {return false;}
+
+  template<typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> handle)
+  {
+    promise = static_cast<detail::nr_promise_base*>(&handle.promise());
+    auto interp = promise->interp;
+    BOOST_ASSERT(detail::nr_interp() == interp);
+
+    Tcl_NRAddCallback(interp,
+                      +[](ClientData data[], Tcl_Interp * interp, int code) -> int
+                      {
+                        auto p = static_cast<detail::nr_promise_base*>(data[0]);
+                        p->code = code;
+                        p->value = Tcl_GetObjResult(interp);
+                        return detail::nr_resume(p, interp);
+                      },
+                      promise, nullptr, nullptr, nullptr);
+    Tcl_NREvalObj(interp, script.get(), flags);
+  }
+
+  result<object_ptr> await_resume()
+  {
+    auto value = std::move(promise->value);
+    if (promise->code != TCL_OK)
+      return result<object_ptr>{boost::system::in_place_error, std::move(value)};
+    return result<object_ptr>{boost::system::in_place_value, std::move(value)};
+  }
+};
+
+/// Evaluate a script from an `nr_task`, without nesting on the C stack.
+inline nr_eval_awaitable nr_eval(object_ptr script, int flags = 0)
+{
+  return nr_eval_awaitable{std::move(script), flags};
+}
+
+/// Awaitable yielding from the enclosing tcl coroutine, the value gets converted once the interpreter is known.
+template<typename T>
+struct nr_yield_awaitable : nr_eval_awaitable
+{
+  T yielded;
+
+  template<typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> handle)
+  {
+    auto interp = handle.promise().interp;
+    object_ptr value = make_object(interp, std::move(yielded));
+    Tcl_Obj * objv[2] = {Tcl_NewStringObj("::yield", -1), value.get()};
+    script = Tcl_NewListObj(2, objv);
+    nr_eval_awaitable::await_suspend(handle);
+  }
+};
+
+/// Yield a value from the tcl coroutine the `nr_task` runs in, resumes with the value the coroutine gets resumed with.
+template<typename T>
+nr_yield_awaitable<std::decay_t<T>> nr_yield(T && value)
+{
+  return nr_yield_awaitable<std::decay_t<T>>{{}, std::forward<T>(value)};
+}
+
+inline nr_eval_awaitable nr_yield()
+{
+  return nr_eval_awaitable{Tcl_NewStringObj("::yield", -1)};
+}
+
+// starts the coroutine when it's returned from a function of a command.
+template<typename T>
+object_ptr tag_invoke(const struct convert_tag &, Tcl_Interp * interp, nr_task<T> && task)
+{
+  BOOST_ASSERT(detail::nr_interp() == interp);
+  const auto res = detail::nr_resume(task.release(), interp);
+  if (res != TCL_OK)
+    throw_result(interp);
+  // either the result of the finished coroutine, or a placeholder that the awaited script will replace.
+  return Tcl_GetObjResult(interp);
+}
+
+#endif
+
+}
+
+#endif //METAL_TCL_NR_HPP
@@ -18,7 +18,11 @@
 #include <boost/core/span.hpp>
 #include <boost/system/result.hpp>
 
+#include <algorithm>
 #include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace metal::tcl
 {
@@ -29,9 +33,20 @@ struct parse_result : Tcl_Parse
   {
     tokenPtr = staticTokens;
   }
-  parse_result(const parse_result & ) noexcept = default;
+  parse_result(const parse_result & lhs) : Tcl_Parse{lhs}
+  {
+    if (lhs.tokenPtr == lhs.staticTokens)
+      tokenPtr = staticTokens;
+    else
+    {
+      tokenPtr = reinterpret_cast<Tcl_Token*>(Tcl_Alloc(sizeof(Tcl_Token) * tokensAvailable));
+      std::copy_n(lhs.tokenPtr, numTokens, tokenPtr);
+    }
+  }
   parse_result(parse_result && lhs) noexcept : Tcl_Parse{lhs}
   {
+    if (lhs.tokenPtr == lhs.staticTokens)
+      tokenPtr = staticTokens;
     lhs.tokenPtr = lhs.staticTokens;
   }
 
@@ -49,8 +64,9 @@ struct parse_result : Tcl_Parse
 
 };
 
-result<void> parse_command(Tcl_Interp * interp, parse_result & parse, boost::core::string_view cmd, bool nested = false)
+inline result<void> parse_command(Tcl_Interp * interp, parse_result & parse, boost::core::string_view cmd, bool nested = false)
 {
+  Tcl_FreeParse(&parse);
   auto cd = Tcl_ParseCommand(interp, cmd.data(), cmd.size(), nested ? 1 : 0, &parse);
   if (cd != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
@@ -58,8 +74,9 @@ result<void> parse_command(Tcl_Interp * interp, parse_result & parse, boost::cor
   return boost::system::in_place_value;
 }
 
-result<void> parse_expr(Tcl_Interp * interp, parse_result & parse, boost::core::string_view cmd)
+inline result<void> parse_expr(Tcl_Interp * interp, parse_result & parse, boost::core::string_view cmd)
 {
+  Tcl_FreeParse(&parse);
   auto cd = Tcl_ParseExpr(interp, cmd.data(), cmd.size(), &parse);
   if (cd != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
@@ -67,10 +84,12 @@ result<void> parse_expr(Tcl_Interp * interp, parse_result & parse, boost::core::
   return boost::system::in_place_value;
 }
 
-result<boost::core::string_view> parse_braces(Tcl_Interp * interp, parse_result & parse,
+inline result<boost::core::string_view> parse_braces(Tcl_Interp * interp, parse_result & parse,
                                               boost::core::string_view cmd, bool append = false)
 {
   const char * term;
+  if (!append)
+    Tcl_FreeParse(&parse);
   auto cd = Tcl_ParseBraces(interp, cmd.data(), cmd.size(), &parse, append ? 1 : 0, & term);
   if (cd != TCL_OK)
     return result<boost::core::string_view>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
@@ -79,10 +98,12 @@ result<boost::core::string_view> parse_braces(Tcl_Interp * interp, parse_result
 }
 
 
-result<boost::core::string_view> parse_quoted_string(Tcl_Interp * interp, parse_result & parse,
+inline result<boost::core::string_view> parse_quoted_string(Tcl_Interp * interp, parse_result & parse,
                                               boost::core::string_view cmd, bool append = false)
 {
   const char * term;
+  if (!append)
+    Tcl_FreeParse(&parse);
   auto cd = Tcl_ParseQuotedString(interp, cmd.data(), cmd.size(), &parse, append ? 1 : 0, & term);
   if (cd != TCL_OK)
     return result<boost::core::string_view>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
@@ -90,9 +111,11 @@ result<boost::core::string_view> parse_quoted_string(Tcl_Interp * interp, parse_
   return {boost::system::in_place_value, boost::core::string_view{cmd.data(), term}};
 }
 
-result<void> parse_var_name(Tcl_Interp * interp, parse_result & parse,
+inline result<void> parse_var_name(Tcl_Interp * interp, parse_result & parse,
                             boost::core::string_view cmd, bool append = false)
 {
+  if (!append)
+    Tcl_FreeParse(&parse);
   auto cd = Tcl_ParseVarName(interp, cmd.data(), cmd.size(), &parse, append ? 1 : 0);
   if (cd != TCL_OK)
     return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp)};
@@ -100,7 +123,7 @@ result<void> parse_var_name(Tcl_Interp * interp, parse_result & parse,
   return boost::system::in_place_value;
 }
 
-result<std::pair<boost::core::string_view, boost::core::string_view>> parse_var(Tcl_Interp * interp,
+inline result<std::pair<boost::core::string_view, boost::core::string_view>> parse_var(Tcl_Interp * interp,
                                     const char * var)
 {
   using result_t = result<std::pair<boost::core::string_view, boost::core::string_view>>;
@@ -113,43 +136,309 @@ result<std::pair<boost::core::string_view, boost::core::string_view>> parse_var(
 }
 
 
-result<void> parse_command(const interpreter_ptr & interp, parse_result & parse, boost::core::string_view cmd, bool nested = false)
+inline result<void> parse_command(const interpreter_ptr & interp, parse_result & parse, boost::core::string_view cmd, bool nested = false)
 {
   return parse_command(interp.get(), parse, cmd, nested);
 
 }
 
-result<void> parse_expr(const interpreter_ptr & interp, parse_result & parse, boost::core::string_view cmd)
+inline result<void> parse_expr(const interpreter_ptr & interp, parse_result & parse, boost::core::string_view cmd)
 {
   return parse_expr(interp.get(), parse, cmd);
 
 }
 
-result<boost::core::string_view> parse_braces(const interpreter_ptr & interp, parse_result & parse,
+inline result<boost::core::string_view> parse_braces(const interpreter_ptr & interp, parse_result & parse,
                                               boost::core::string_view cmd, bool append = false)
 {
   return parse_braces(interp.get(), parse, cmd, append);
 }
 
 
-result<boost::core::string_view> parse_quoted_string(const interpreter_ptr & interp, parse_result & parse,
+inline result<boost::core::string_view> parse_quoted_string(const interpreter_ptr & interp, parse_result & parse,
                                                      boost::core::string_view cmd, bool append = false)
 {
   return parse_quoted_string(interp.get(), parse, cmd, append);
 }
 
-result<void> parse_var_name(const interpreter_ptr & interp, parse_result & parse,
+inline result<void> parse_var_name(const interpreter_ptr & interp, parse_result & parse,
                             boost::core::string_view cmd, bool append = false)
 {
   return parse_var_name(interp.get(), parse, cmd, append);
 }
 
-result<std::pair<boost::core::string_view, boost::core::string_view>> parse_var(const interpreter_ptr & interp,
+inline result<std::pair<boost::core::string_view, boost::core::string_view>> parse_var(const interpreter_ptr & interp,
                                                                                 const char * var)
 {
   return parse_var(interp.get(), var);
 }
 
+namespace detail
+{
+
+// Tracks the nesting of a script incrementally, so the end of a top-level command can be found
+// without scanning the same input twice. It's conservative: the result is only used to decide
+// when to hand the command to Tcl_ParseCommand.
+struct command_scanner
+{
+  enum class context : unsigned char { script, nested, bare, brace, quote, comment, var_brace };
+
+  std::vector<context> stack{context::script};
+  std::size_t depth = 0u; // of the current brace word
+  bool escaped = false;
+  bool command_start = true;
+  bool dollar = false;
+
+  void reset()
+  {
+    stack.assign(1u, context::script);
+    depth = 0u;
+    escaped = dollar = false;
+    command_start = true;
+  }
+
+  static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+  // returns the position behind the terminator of the top-level command or npos.
+  std::size_t scan(boost::core::string_view sv, std::size_t pos)
+  {
+    for (; pos < sv.size(); pos++)
+    {
+      const char c = sv[pos];
+      const bool after_dollar = std::exchange(dollar, false);
+      if (escaped)
+      {
+        escaped = false;
+        // backslash-newline separates words
+        if (c == '\n' && stack.back() == context::bare)
+          stack.pop_back();
+        continue;
+      }
+
+      switch (stack.back())
+      {
+        case context::script:
+        case context::nested:
+          if (is_space(c))
+            break;
+          if (c == '\n' || c == ';')
+          {
+            command_start = true;
+            if (stack.back() == context::script)
+              return pos + 1;
+            break;
+          }
+          if (c == ']' && stack.back() == context::nested)
+          {
+            stack.pop_back();
+            break;
+          }
+          if (c == '#' && command_start)
+          {
+            stack.push_back(context::comment);
+            break;
+          }
+          command_start = false;
+          if (c == '{')
+          {
+            stack.push_back(context::brace);
+            depth = 1u;
+          }
+          else if (c == '"')
+            stack.push_back(context::quote);
+          else
+          {
+            stack.push_back(context::bare);
+            word_char(c);
+          }
+          break;
+        case context::bare:
+          if (is_space(c))
+            stack.pop_back();
+          else if (c == '\n' || c == ';')
+          {
+            stack.pop_back();
+            command_start = true;
+            if (stack.back() == context::script)
+              return pos + 1;
+          }
+          else if (c == ']' && stack[stack.size() - 2u] == context::nested)
+          {
+            stack.pop_back();
+            stack.pop_back();
+          }
+          else if (c == '{' && after_dollar)
+            stack.push_back(context::var_brace);
+          else
+            word_char(c);
+          break;
+        case context::quote:
+          if (c == '"')
+            stack.pop_back();
+          else if (c == '{' && after_dollar)
+            stack.push_back(context::var_brace);
+          else
+            word_char(c);
+          break;
+        case context::var_brace:
+          if (c == '}')
+            stack.pop_back();
+          break;
+        case context::brace:
+          if (c == '\\')
+            escaped = true;
+          else if (c == '{')
+            depth++;
+          else if (c == '}' && --depth == 0u)
+            stack.pop_back();
+          break;
+        case context::comment:
+          if (c == '\\')
+            escaped = true;
+          else if (c == '\n')
+          {
+            stack.pop_back();
+            command_start = true;
+          }
+          break;
+      }
+    }
+    return boost::core::string_view::npos;
+  }
+
+ private:
+  // substitutions within a bare or quoted word
+  void word_char(char c)
+  {
+    if (c == '\\')
+      escaped = true;
+    else if (c == '[')
+    {
+      stack.push_back(context::nested);
+      command_start = true;
+    }
+    else if (c == '$')
+      dollar = true;
+  }
+};
+
+}
+
+/** Splits an append-only buffer into commands incrementally.
+ *
+ * Input can be appended in arbitrary chunks, `next` yields the complete commands as views into the buffer.
+ * Scanning resumes where it stopped, so the whole input is split in linear time.
+ * The views get invalidated by the next `append` or `prepare`.
+ *
+ * @code
+ * tcl::command_stream cs{interp};
+ * cs.append(data);
+ * while (auto cmd = cs.next().value())
+ *   tcl::eval(interp, *cmd);
+ * @endcode
+ */
+struct command_stream
+{
+  explicit command_stream(Tcl_Interp * interp) : interp_(interp) {}
+  explicit command_stream(const interpreter_ptr & interp) : interp_(interp.get()) {}
+
+  void append(boost::core::string_view data)
+  {
+    compact_();
+    buffer_.append(data.data(), data.size());
+  }
+
+  /// Get a writable area of `n` bytes at the end of the buffer, e.g. to read into it directly.
+  boost::span<char> prepare(std::size_t n)
+  {
+    compact_();
+    prepared_ = buffer_.size();
+    buffer_.resize(prepared_ + n);
+    return {buffer_.data() + prepared_, n};
+  }
+
+  /// Append the first `n` bytes of the area obtained by `prepare`.
+  void commit(std::size_t n)
+  {
+    buffer_.resize(prepared_ + n);
+    prepared_ = buffer_.size();
+  }
+
+  /// Mark the end of the input, so that `next` yields the last command even without a terminator.
+  void finish() {finished_ = true;}
+
+  /** Get the next complete command.
+   *
+   * @returns an empty optional if more input is needed or a parse error. The erroneous command is skipped.
+   */
+  result<std::optional<boost::core::string_view>> next()
+  {
+    using result_t = result<std::optional<boost::core::string_view>>;
+    while (consumed_ < buffer_.size())
+    {
+      auto end = scanner_.scan(buffer_, scanned_);
+      if (end == boost::core::string_view::npos)
+      {
+        scanned_ = buffer_.size();
+        if (!finished_)
+          return result_t{boost::system::in_place_value};
+        end = buffer_.size();
+      }
+      else
+        scanned_ = end;
+
+      Tcl_FreeParse(&parse_);
+      // the scanner only tells us where to try, Tcl decides where the command ends.
+      const auto rest = boost::core::string_view(buffer_).substr(consumed_);
+      if (Tcl_ParseCommand(interp_, rest.data(), rest.size(), 0, &parse_) != TCL_OK)
+      {
+        if (parse_.incomplete && !finished_)
+          continue;
+        object_ptr err = Tcl_GetObjResult(interp_);
+        consumed_ = (std::max)(end, scanned_);
+        restart_();
+        return result_t{boost::system::in_place_error, std::move(err)};
+      }
+
+      consumed_ = (parse_.commandStart - buffer_.data()) + parse_.commandSize;
+      restart_();
+      if (parse_.numWords > 0)
+        return result_t{boost::system::in_place_value, parse_.command()};
+    }
+    return result_t{boost::system::in_place_value};
+  }
+
+  /// The parse result of the last command returned by `next`.
+  const parse_result & parsed() const {return parse_;}
+
+  /// The input that hasn't been returned as a command yet.
+  boost::core::string_view pending() const { return boost::core::string_view(buffer_).substr(consumed_); }
+
+ private:
+  void restart_()
+  {
+    scanner_.reset();
+    scanned_ = consumed_;
+  }
+
+  // drop the consumed part once it's at least half of the buffer, so appending stays amortized O(1)
+  void compact_()
+  {
+    if (consumed_ == 0u || consumed_ * 2u < buffer_.size())
+      return;
+    buffer_.erase(0u, consumed_);
+    scanned_ -= consumed_;
+    consumed_ = 0u;
+  }
+
+  Tcl_Interp * interp_;
+  std::string buffer_;
+  std::size_t consumed_ = 0u, scanned_ = 0u, prepared_ = 0u;
+  bool finished_ = false;
+  detail::command_scanner scanner_;
+  parse_result parse_;
+};
+
 
 }
 
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_PREPARED_SCRIPT_HPP
+#define METAL_TCL_PREPARED_SCRIPT_HPP
+
+#include <tcl.h>
+#include <metal/tcl/cast.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+#include <boost/system/result.hpp>
+
+#include <array>
+#include <initializer_list>
+
+namespace metal::tcl
+{
+
+/** A script with named parameters, that gets compiled once and can be invoked with C++ values.
+ *
+ * It's implemented as an `apply` lambda, i.e. the parameters are local variables of the script
+ * and the arguments are passed as objects, so nothing gets formatted into the script.
+ *
+ * @code
+ * tcl::prepared_script add{interp, {"x", "y"}, "expr {$x + $y}"};
+ * int res = add.invoke<int>(1, 2).value();
+ * @endcode
+ */
+struct prepared_script
+{
+  prepared_script(Tcl_Interp * interp,
+                  std::initializer_list<boost::core::string_view> params,
+                  boost::core::string_view body,
+                  boost::core::string_view ns = {})
+      : interp_(interp), apply_(Tcl_NewStringObj("::apply", -1)), lambda_(Tcl_NewListObj(0, nullptr))
+  {
+    auto ps = Tcl_NewListObj(0, nullptr);
+    for (auto p : params)
+      Tcl_ListObjAppendElement(interp, ps, Tcl_NewStringObj(p.data(), p.size()));
+    Tcl_ListObjAppendElement(interp, lambda_.get(), ps);
+    Tcl_ListObjAppendElement(interp, lambda_.get(), Tcl_NewStringObj(body.data(), body.size()));
+    if (!ns.empty())
+      Tcl_ListObjAppendElement(interp, lambda_.get(), Tcl_NewStringObj(ns.data(), ns.size()));
+  }
+
+  prepared_script(const interpreter_ptr & interp,
+                  std::initializer_list<boost::core::string_view> params,
+                  boost::core::string_view body,
+                  boost::core::string_view ns = {})
+      : prepared_script(interp.get(), params, body, ns)
+  {
+  }
+
+  /// Invoke the script, the arguments get converted with `make_object`.
+  template<typename T = object_ptr, typename ... Args>
+  result<T> invoke(Args && ... args) const
+  {
+    // keep the converted arguments alive until the call is done
+    const std::array<object_ptr, sizeof...(Args)> values{make_object(interp_, std::forward<Args>(args))...};
+    std::array<Tcl_Obj*, sizeof...(Args) + 2u> objv{apply_.get(), lambda_.get()};
+    for (std::size_t i = 0u; i < values.size(); i++)
+      objv[i + 2u] = values[i].get();
+
+    auto res = Tcl_EvalObjv(interp_, static_cast<int>(objv.size()), objv.data(), 0);
+    if constexpr (std::is_void_v<T>)
+    {
+      if (res != TCL_OK)
+        return result<void>{boost::system::in_place_error, Tcl_GetObjResult(interp_)};
+      return result<void>{boost::system::in_place_value};
+    }
+    else
+    {
+      if (res != TCL_OK)
+        return result<T>{boost::system::in_place_error, Tcl_GetObjResult(interp_)};
+      return result<T>{boost::system::in_place_value, cast<T>(interp_, Tcl_GetObjResult(interp_))};
+    }
+  }
+
+  template<typename ... Args>
+  result<object_ptr> operator()(Args && ... args) const
+  {
+    return invoke<object_ptr>(std::forward<Args>(args)...);
+  }
+
+  Tcl_Interp * interpreter() const {return interp_;}
+
+ private:
+  Tcl_Interp * interp_;
+  object_ptr apply_;
+  // holds the compiled body as its internal rep, so it must not be handed out.
+  object_ptr lambda_;
+};
+
+}
+
+#endif //METAL_TCL_PREPARED_SCRIPT_HPP
@@ -0,0 +1,481 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_SHARED_HPP
+#define METAL_TCL_SHARED_HPP
+
+#include <tcl.h>
+#include <metal/tcl/command.hpp>
+#include <metal/tcl/exception.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+
+#include <boost/core/detail/string_view.hpp>
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// formats a double like tcl does with the default tcl_precision, i.e. the shortest representation that round-trips.
+inline std::string format_double(double d)
+{
+  if (std::isnan(d))
+    return std::signbit(d) ? "-NaN" : "NaN";
+  if (std::isinf(d))
+    return d < 0. ? "-Inf" : "Inf";
+
+  // the shortest digits, e.g. "-1.25e+20"
+  char buf[64];
+  const auto end = std::to_chars(buf, buf + sizeof(buf), d, std::chars_format::scientific).ptr;
+  const boost::core::string_view sci{buf, static_cast<std::size_t>(end - buf)};
+  const auto e = sci.find('e');
+  const bool negative = sci.front() == '-';
+
+  std::string digits;
+  for (auto c : sci.substr(negative ? 1u : 0u, e - (negative ? 1u : 0u)))
+    if (c != '.')
+      digits += c;
+  int exponent = 0;
+  std::from_chars(sci.data() + e + (sci[e + 1u] == '+' ? 2u : 1u), sci.data() + sci.size(), exponent);
+
+  std::string res = negative ? "-" : "";
+  if (exponent < -4 || exponent > 16)
+  {
+    res += digits.front();
+    if (digits.size() > 1u)
+      res.append(".").append(digits, 1u);
+    res += exponent < 0 ? "e-" : "e+";
+    res += std::to_string(exponent < 0 ? -exponent : exponent);
+  }
+  else if (exponent < 0)
+    res.append("0.").append(static_cast<std::size_t>(-exponent - 1), '0').append(digits);
+  else
+  {
+    const auto int_digits = static_cast<std::size_t>(exponent) + 1u;
+    if (digits.size() <= int_digits)
+      res.append(digits).append(int_digits - digits.size(), '0').append(".0");
+    else
+      res.append(digits, 0u, int_digits).append(".").append(digits, int_digits);
+  }
+  return res;
+}
+
+// parses an integer like tcl does: with surrounding whitespace, a sign & a 0x, 0o, 0b or 0 (octal) prefix.
+// returns false if it's not an integer & throws if it doesn't fit.
+inline bool parse_integer(boost::core::string_view s, Tcl_WideInt & value)
+{
+  constexpr boost::core::string_view space = " \t\n\v\f\r";
+  const auto first = s.find_first_not_of(space);
+  if (first == boost::core::string_view::npos)
+    return false;
+  s = s.substr(first, s.find_last_not_of(space) + 1u - first);
+
+  const bool negative = s.front() == '-';
+  if (negative || s.front() == '+')
+    s.remove_prefix(1u);
+
+  int base = 10;
+  if (s.size() > 1u && s[0] == '0')
+  {
+    switch (s[1])
+    {
+      case 'x': case 'X': base = 16; s.remove_prefix(2u); break;
+      case 'o': case 'O': base = 8;  s.remove_prefix(2u); break;
+      case 'b': case 'B': base = 2;  s.remove_prefix(2u); break;
+      default:            base = 8;  s.remove_prefix(1u); break;
+    }
+  }
+  // from_chars would take another sign
+  if (s.empty() || s.front() == '-' || s.front() == '+')
+    return false;
+
+  std::uint64_t magnitude = 0u;
+  const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), magnitude, base);
+  if (ptr != s.data() + s.size())
+    return false;
+
+  constexpr auto max = static_cast<std::uint64_t>((std::numeric_limits<Tcl_WideInt>::max)());
+  if (ec == std::errc::result_out_of_range || magnitude > max + (negative ? 1u : 0u))
+    throw std::overflow_error("integer value too large to represent");
+  value = negative ? static_cast<Tcl_WideInt>(0u - magnitude) : static_cast<Tcl_WideInt>(magnitude);
+  return true;
+}
+
+}
+
+/** A value of a `shared_store`.
+ *
+ * Tcl objects are confined to the thread that created them, so values are stored as plain C++ types
+ * and converted into a new object on every access.
+ */
+struct shared_value
+{
+  std::variant<std::string, Tcl_WideInt, double> value;
+
+  shared_value() = default;
+  shared_value(std::string s) : value(std::move(s)) {}
+  shared_value(const char * s) : value(std::string(s)) {}
+  shared_value(Tcl_WideInt i) : value(i) {}
+  shared_value(int i) : value(static_cast<Tcl_WideInt>(i)) {}
+  shared_value(double d) : value(d) {}
+
+  /// Takes the value of an object, keeping numbers as numbers.
+  static shared_value from_object(Tcl_Obj * obj)
+  {
+    static const Tcl_ObjType * int_type    = Tcl_GetObjType("int");
+    static const Tcl_ObjType * wide_type   = Tcl_GetObjType("wideInt");
+    static const Tcl_ObjType * double_type = Tcl_GetObjType("double");
+
+    if (obj->typePtr != nullptr && (obj->typePtr == int_type || obj->typePtr == wide_type))
+    {
+      Tcl_WideInt i;
+      if (Tcl_GetWideIntFromObj(nullptr, obj, &i) == TCL_OK)
+        return shared_value{i};
+    }
+    else if (obj->typePtr != nullptr && obj->typePtr == double_type)
+    {
+      double d;
+      if (Tcl_GetDoubleFromObj(nullptr, obj, &d) == TCL_OK)
+        return shared_value{d};
+    }
+
+    int len = 0;
+    const char * str = Tcl_GetStringFromObj(obj, &len);
+    return shared_value{std::string(str, len)};
+  }
+
+  /// A new object, for the calling thread.
+  object_ptr to_object() const
+  {
+    if (auto s = std::get_if<std::string>(&value))
+      return Tcl_NewStringObj(s->data(), static_cast<int>(s->size()));
+    else if (auto i = std::get_if<Tcl_WideInt>(&value))
+      return Tcl_NewWideIntObj(*i);
+    else
+      return Tcl_NewDoubleObj(std::get<double>(value));
+  }
+
+  /// The string representation, as tcl would print it. Doesn't use any tcl objects.
+  std::string to_string() const
+  {
+    if (auto s = std::get_if<std::string>(&value))
+      return *s;
+    else if (auto i = std::get_if<Tcl_WideInt>(&value))
+      return std::to_string(*i);
+    else
+      return detail::format_double(std::get<double>(value));
+  }
+
+  /// Values of different types are compared by their string representation, like tcl does.
+  friend bool operator==(const shared_value & lhs, const shared_value & rhs)
+  {
+    if (lhs.value.index() == rhs.value.index())
+      return lhs.value == rhs.value;
+    return lhs.to_string() == rhs.to_string();
+  }
+
+  friend bool operator!=(const shared_value & lhs, const shared_value & rhs)
+  {
+    return !(lhs == rhs);
+  }
+};
+
+/** A key/value store that can be used from any thread, e.g. to share state between worker interpreters.
+ *
+ * The keys are distributed over independently locked stripes, so threads working on different keys
+ * rarely contend, and reads of the same stripe don't block each other.
+ * All operations are atomic with respect to each other.
+ */
+struct shared_store
+{
+  constexpr static std::size_t stripe_count = 64u;
+
+  shared_store() = default;
+  shared_store(const shared_store & ) = delete;
+
+  /// The store used by the `metal::shared` command, shared by all interpreters of the process.
+  static shared_store & global()
+  {
+    static shared_store store;
+    return store;
+  }
+
+  std::optional<shared_value> get(boost::core::string_view key) const
+  {
+    auto & st = stripe_(key);
+    std::shared_lock<std::shared_mutex> lock{st.mtx};
+    auto itr = st.values.find(std::string(key));
+    if (itr == st.values.end())
+      return std::nullopt;
+    return itr->second;
+  }
+
+  bool exists(boost::core::string_view key) const
+  {
+    auto & st = stripe_(key);
+    std::shared_lock<std::shared_mutex> lock{st.mtx};
+    return st.values.count(std::string(key)) > 0u;
+  }
+
+  void set(boost::core::string_view key, shared_value value)
+  {
+    auto & st = stripe_(key);
+    std::unique_lock<std::shared_mutex> lock{st.mtx};
+    st.values[std::string(key)] = std::move(value);
+  }
+
+  /// Returns false if the key didn't exist.
+  bool unset(boost::core::string_view key)
+  {
+    auto & st = stripe_(key);
+    std::unique_lock<std::shared_mutex> lock{st.mtx};
+    return st.values.erase(std::string(key)) > 0u;
+  }
+
+  /** Add to an integer value & return the result. A missing key counts as 0.
+   *
+   * Strings are parsed like tcl does, e.g. `0x10` or ` +5 `. Results that don't fit into a `Tcl_WideInt`
+   * throw `std::overflow_error`, where tcl's `incr` would switch to a bignum.
+   */
+  Tcl_WideInt incr(boost::core::string_view key, Tcl_WideInt delta = 1)
+  {
+    auto & st = stripe_(key);
+    std::unique_lock<std::shared_mutex> lock{st.mtx};
+    auto & val = st.values[std::string(key)].value;
+
+    Tcl_WideInt current = 0;
+    if (auto i = std::get_if<Tcl_WideInt>(&val))
+      current = *i;
+    else if (auto s = std::get_if<std::string>(&val); s && !s->empty())
+    {
+      if (!detail::parse_integer(*s, current))
+        throw std::invalid_argument("expected integer but got \"" + *s + "\"");
+    }
+    else if (std::holds_alternative<double>(val))
+      throw std::invalid_argument("expected integer but got \"" + detail::format_double(std::get<double>(val)) + "\"");
+
+    using limits = std::numeric_limits<Tcl_WideInt>;
+    if (delta > 0 ? current > (limits::max)() - delta : current < (limits::min)() - delta)
+      throw std::overflow_error("integer value too large to represent");
+    val = current + delta;
+    return current + delta;
+  }
+
+  /// Append to the string representation of a value & return the result. A missing key counts as empty.
+  std::string append(boost::core::string_view key, boost::core::string_view str)
+  {
+    auto & st = stripe_(key);
+    std::unique_lock<std::shared_mutex> lock{st.mtx};
+    auto & val = st.values[std::string(key)];
+    if (!std::holds_alternative<std::string>(val.value))
+      val.value = val.to_string();
+    auto & s = std::get<std::string>(val.value);
+    s.append(str.data(), str.size());
+    return s;
+  }
+
+  /// Replace the value with `desired` if it equals `expected`. Returns false if it didn't or the key doesn't exist.
+  bool compare_and_swap(boost::core::string_view key, const shared_value & expected, shared_value desired)
+  {
+    auto & st = stripe_(key);
+    std::unique_lock<std::shared_mutex> lock{st.mtx};
+    auto itr = st.values.find(std::string(key));
+    if (itr == st.values.end() || itr->second != expected)
+      return false;
+    itr->second = std::move(desired);
+    return true;
+  }
+
+  /// All keys, in no particular order. Keys modified concurrently may or may not be included.
+  std::vector<std::string> keys() const
+  {
+    std::vector<std::string> res;
+    for (auto & st : stripes_)
+    {
+      std::shared_lock<std::shared_mutex> lock{st.mtx};
+      for (auto & [k, v] : st.values)
+        res.push_back(k);
+    }
+    return res;
+  }
+
+  std::size_t size() const
+  {
+    std::size_t res = 0u;
+    for (auto & st : stripes_)
+    {
+      std::shared_lock<std::shared_mutex> lock{st.mtx};
+      res += st.values.size();
+    }
+    return res;
+  }
+
+ private:
+  // each stripe on its own cache line, so locking one doesn't slow down its neighbours.
+  struct alignas(64) stripe
+  {
+    mutable std::shared_mutex mtx;
+    std::unordered_map<std::string, shared_value> values;
+  };
+
+  stripe & stripe_(boost::core::string_view key) const
+  {
+    const auto h = std::hash<std::string_view>{}(std::string_view{key.data(), key.size()});
+    return stripes_[h % stripe_count];
+  }
+
+  mutable std::array<stripe, stripe_count> stripes_;
+};
+
+/** Create a command giving scripts access to a `shared_store`.
+ *
+ * The command has the sub-commands
+ *
+ *  - `get key ?default?`, which fails for missing keys without a default
+ *  - `set key value`
+ *  - `unset key`, `exists key`
+ *  - `incr key ?delta?`, `append key string`
+ *  - `cas key expected new`, which returns whether the value got replaced
+ *  - `keys ?pattern?`, `size`
+ *
+ * @code
+ * tcl::create_shared_command(interp);
+ * tcl::eval(interp, "metal::shared incr jobs_done");
+ * @endcode
+ */
+inline command & create_shared_command(Tcl_Interp * interp,
+                                       const char * name = "metal::shared",
+                                       shared_store & store = shared_store::global())
+{
+  auto & cmd = create_command(interp, name);
+  auto str = [](const object_ptr & obj)
+  {
+    int len = 0;
+    const char * s = Tcl_GetStringFromObj(obj.get(), &len);
+    return boost::core::string_view{s, static_cast<std::size_t>(len)};
+  };
+
+  cmd.add_subcommand("get")
+     .add_function(
+         [&store, str](object_ptr key) -> object_ptr
+         {
+           auto val = store.get(str(key));
+           if (!val)
+             throw std::out_of_range("no such key \"" + std::string(str(key)) + "\"");
+           return val->to_object();
+         })
+     .add_function(
+         [&store, str](object_ptr key, object_ptr default_) -> object_ptr
+         {
+           auto val = store.get(str(key));
+           return val ? val->to_object() : default_;
+         });
+
+  cmd.add_subcommand("set")
+     .add_function(
+         [&store, str](object_ptr key, object_ptr value) -> object_ptr
+         {
+           store.set(str(key), shared_value::from_object(value.get()));
+           return value;
+         });
+
+  cmd.add_subcommand("unset")
+     .add_function(
+         [&store, str](object_ptr key) -> object_ptr
+         {
+           return Tcl_NewBooleanObj(store.unset(str(key)));
+         });
+
+  cmd.add_subcommand("exists")
+     .add_function(
+         [&store, str](object_ptr key) -> object_ptr
+         {
+           return Tcl_NewBooleanObj(store.exists(str(key)));
+         });
+
+  cmd.add_subcommand("incr")
+     .add_function(
+         [&store, str](object_ptr key) -> object_ptr
+         {
+           return Tcl_NewWideIntObj(store.incr(str(key)));
+         })
+     .add_function_with_interp(
+         [&store, str](Tcl_Interp * interp, object_ptr key, object_ptr delta) -> object_ptr
+         {
+           Tcl_WideInt d;
+           if (Tcl_GetWideIntFromObj(interp, delta.get(), &d) != TCL_OK)
+             throw_result(interp);
+           return Tcl_NewWideIntObj(store.incr(str(key), d));
+         });
+
+  cmd.add_subcommand("append")
+     .add_function(
+         [&store, str](object_ptr key, object_ptr value) -> object_ptr
+         {
+           auto res = store.append(str(key), str(value));
+           return Tcl_NewStringObj(res.data(), static_cast<int>(res.size()));
+         });
+
+  cmd.add_subcommand("cas")
+     .add_function(
+         [&store, str](object_ptr key, object_ptr expected, object_ptr desired) -> object_ptr
+         {
+           return Tcl_NewBooleanObj(
+               store.compare_and_swap(str(key), shared_value::from_object(expected.get()),
+                                      shared_value::from_object(desired.get())));
+         });
+
+  auto keys = [&store](const char * pattern) -> object_ptr
+  {
+    object_ptr res{Tcl_NewListObj(0, nullptr)};
+    for (auto & k : store.keys())
+      if (pattern == nullptr || Tcl_StringMatch(k.c_str(), pattern))
+        Tcl_ListObjAppendElement(nullptr, res.get(), Tcl_NewStringObj(k.data(), static_cast<int>(k.size())));
+    return res;
+  };
+
+  cmd.add_subcommand("keys")
+     .add_function([keys]() -> object_ptr {return keys(nullptr);})
+     .add_function([keys](object_ptr pattern) -> object_ptr {return keys(Tcl_GetString(pattern.get()));});
+
+  cmd.add_subcommand("size")
+     .add_function(
+         [&store]() -> object_ptr
+         {
+           return Tcl_NewWideIntObj(static_cast<Tcl_WideInt>(store.size()));
+         });
+
+  return cmd;
+}
+
+inline command & create_shared_command(const interpreter_ptr & interp,
+                                       const char * name = "metal::shared",
+                                       shared_store & store = shared_store::global())
+{
+  return create_shared_command(interp.get(), name, store);
+}
+
+}
+
+#endif //METAL_TCL_SHARED_HPP
@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_SOCKET_CHANNEL_HPP
+#define METAL_TCL_SOCKET_CHANNEL_HPP
+
+#include <tcl.h>
+#include <metal/tcl/channel.hpp>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/core/detail/string_view.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// the readiness of the socket is watched with Tcl_CreateFileHandler, which only exists on unix.
+#if !defined(_WIN32)
+
+namespace metal::tcl
+{
+
+template<typename Socket>
+Tcl_Channel create_socket_channel(Socket && socket, const char * name = nullptr);
+
+/** A non-blocking tcl channel over an asio stream socket, e.g. `tcp::socket` or `local::stream_protocol::socket`.
+ *
+ * The socket's descriptor is registered with tcl's notifier when the channel gets watched, so `fileevent`
+ * works and any number of channels can be served by a single event loop, without a thread per channel.
+ * The channel owns the socket & closes it when the channel is closed.
+ *
+ * Use `create_socket_channel` to create it.
+ */
+template<typename Socket>
+struct socket_channel
+{
+  socket_channel(const socket_channel &) = delete;
+
+  int input(char *buf, int to_read, int &error)
+  {
+    boost::system::error_code ec;
+    const auto n = socket_.read_some(boost::asio::buffer(buf, static_cast<std::size_t>(to_read)), ec);
+    if (ec == boost::asio::error::eof)
+      return 0;
+    return result_(n, ec, error);
+  }
+
+  int output(const char *buf, int to_write, int &error)
+  {
+    boost::system::error_code ec;
+    const auto n = socket_.write_some(boost::asio::buffer(buf, static_cast<std::size_t>(to_write)), ec);
+    return result_(n, ec, error);
+  }
+
+  int seek(std::int64_t, int, int &error)
+  {
+    error = EINVAL;
+    return -1;
+  }
+
+  int set_option(Tcl_Interp *interp, const char *name, const char *)
+  {
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  int get_option(Tcl_Interp *interp, const char *name, Tcl_DString & string)
+  {
+    const boost::core::string_view nm = name == nullptr ? "" : name;
+    boost::system::error_code ec;
+    if (nm.empty() || nm == "-peername")
+    {
+      if (nm.empty())
+        Tcl_DStringAppendElement(&string, "-peername");
+      append_endpoint_(string, socket_.remote_endpoint(ec));
+    }
+    if (nm.empty() || nm == "-sockname")
+    {
+      if (nm.empty())
+        Tcl_DStringAppendElement(&string, "-sockname");
+      append_endpoint_(string, socket_.local_endpoint(ec));
+    }
+    if (!nm.empty() && nm != "-peername" && nm != "-sockname")
+      return Tcl_BadChannelOption(interp, name, "peername sockname");
+    return TCL_OK;
+  }
+
+  void watch(int mask)
+  {
+    const int fd = static_cast<int>(socket_.native_handle());
+    if (mask != 0)
+      Tcl_CreateFileHandler(fd, mask,
+                            +[](ClientData data, int mask)
+                            {
+                              Tcl_NotifyChannel(static_cast<socket_channel*>(data)->channel_, mask);
+                            }, this);
+    else
+      Tcl_DeleteFileHandler(fd);
+  }
+
+  int close(Tcl_Interp *, int flags)
+  {
+    boost::system::error_code ec;
+    if (flags & TCL_CLOSE_READ)
+      socket_.shutdown(boost::asio::socket_base::shutdown_receive, ec);
+    else if (flags & TCL_CLOSE_WRITE)
+      socket_.shutdown(boost::asio::socket_base::shutdown_send, ec);
+    else
+    {
+      Tcl_DeleteFileHandler(static_cast<int>(socket_.native_handle()));
+      socket_.close(ec);
+      delete this;
+      return 0;
+    }
+    return ec ? ec.value() : 0;
+  }
+
+  int block_mode(bool blocking)
+  {
+    boost::system::error_code ec;
+    socket_.non_blocking(!blocking, ec);
+    return ec ? ec.value() : 0;
+  }
+
+  int handler(int interest_mask)
+  {
+    return interest_mask;
+  }
+
+  ClientData get_handle(int)
+  {
+    return reinterpret_cast<ClientData>(static_cast<std::intptr_t>(socket_.native_handle()));
+  }
+
+  Socket & socket() {return socket_;}
+  Tcl_Channel channel() const {return channel_;}
+
+ private:
+  template<typename S>
+  friend Tcl_Channel create_socket_channel(S && socket, const char * name);
+
+  explicit socket_channel(Socket && socket) : socket_(std::move(socket)) {}
+
+  static int result_(std::size_t n, const boost::system::error_code & ec, int & error)
+  {
+    if (!ec)
+      return static_cast<int>(n);
+    // tcl expects errno values, and EAGAIN when a non-blocking channel has nothing to do.
+    error = ec == boost::asio::error::would_block ? EAGAIN : ec.value();
+    return -1;
+  }
+
+  template<typename Endpoint>
+  static void append_endpoint_(Tcl_DString & string, const Endpoint & ep)
+  {
+    std::ostringstream str;
+    str << ep;
+    Tcl_DStringAppendElement(&string, str.str().c_str());
+  }
+
+  Socket socket_;
+  Tcl_Channel channel_ = nullptr;
+};
+
+template<typename Socket>
+auto tag_invoke(detail::get_class_name_tag<socket_channel<Socket>>) -> boost::core::string_view
+{
+  return "asio_socket";
+}
+
+/** Create a channel that takes ownership of a connected asio stream socket.
+ *
+ * Unlike tcl's own sockets, the channel starts out in non-blocking mode, use `fconfigure $chan -blocking 1` to change that.
+ * The translation is `auto crlf`, like tcl's. The channel needs to be registered with an interpreter,
+ * e.g. with `Tcl_RegisterChannel`. If no name is given, a unique one is generated.
+ *
+ * @code
+ * acceptor.async_accept(
+ *   [interp](boost::system::error_code ec, tcp::socket sock)
+ *   {
+ *     auto chan = tcl::create_socket_channel(std::move(sock));
+ *     Tcl_RegisterChannel(interp, chan);
+ *     tcl::eval(interp, std::string("serve ") + Tcl_GetChannelName(chan));
+ *   });
+ * @endcode
+ */
+template<typename Socket>
+Tcl_Channel create_socket_channel(Socket && socket, const char * name)
+{
+  static_assert(!std::is_lvalue_reference_v<Socket>, "the channel takes ownership of the socket");
+  using impl_t = socket_channel<std::decay_t<Socket>>;
+
+  std::string nm;
+  if (name == nullptr)
+  {
+    static std::atomic<unsigned> counter{0u};
+    nm = "asiosock" + std::to_string(counter++);
+    name = nm.c_str();
+  }
+
+  auto impl = new impl_t(std::move(socket));
+  boost::system::error_code ec;
+  impl->socket_.non_blocking(true, ec);
+  impl->channel_ = create_channel(*impl, name, TCL_READABLE | TCL_WRITABLE);
+  // on purpose, unlike tcl's own sockets: one blocking read would stall the event loop for every other connection.
+  Tcl_SetChannelOption(nullptr, impl->channel_, "-blocking", "0");
+  // like tcl's own sockets
+  Tcl_SetChannelOption(nullptr, impl->channel_, "-translation", "auto crlf");
+  return impl->channel_;
+}
+
+}
+
+#endif
+
+#endif //METAL_TCL_SOCKET_CHANNEL_HPP
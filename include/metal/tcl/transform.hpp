@@ -0,0 +1,354 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_TRANSFORM_HPP
+#define METAL_TCL_TRANSFORM_HPP
+
+#include <tcl.h>
+#include <metal/tcl/channel.hpp>
+
+#include <boost/core/span.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace metal::tcl
+{
+
+template<typename Impl, typename ... Args>
+Tcl_Channel create_transform(Tcl_Interp * interp, Tcl_Channel chan, Args && ... args);
+
+namespace detail
+{
+
+template<typename Impl>
+constexpr int transform_mask(rank<0>) {return 0;}
+
+template<typename Impl,
+          typename = decltype(std::declval<Impl&>().input(std::declval<boost::span<const char>>(), std::declval<std::string&>()))>
+constexpr int transform_mask(rank<1>) {return TCL_READABLE;}
+
+template<typename Impl>
+constexpr int transform_output_mask(rank<0>) {return 0;}
+
+template<typename Impl,
+          typename = decltype(std::declval<Impl&>().output(std::declval<boost::span<const char>>(), std::declval<std::string&>()))>
+constexpr int transform_output_mask(rank<1>) {return TCL_WRITABLE;}
+
+template<typename Impl>
+void transform_finish_input(Impl &, std::string &, rank<0>) {}
+
+template<typename Impl, typename = decltype(std::declval<Impl&>().finish_input(std::declval<std::string&>()))>
+void transform_finish_input(Impl & impl, std::string & out, rank<1>) {impl.finish_input(out);}
+
+template<typename Impl>
+void transform_finish_output(Impl &, std::string &, rank<0>) {}
+
+template<typename Impl, typename = decltype(std::declval<Impl&>().finish_output(std::declval<std::string&>()))>
+void transform_finish_output(Impl & impl, std::string & out, rank<1>) {impl.finish_output(out);}
+
+}
+
+/** A channel stacked on top of another one with `Tcl_StackChannel`, which transforms the data with `Impl`.
+ *
+ * Impl gets called with whole chunks of data & appends its result to a string:
+ *
+ *  - `void input(boost::span<const char> raw, std::string & out)`: data read from the channel below.
+ *  - `void output(boost::span<const char> data, std::string & out)`: data written to the channel.
+ *  - `void finish_input(std::string & out)`: optional, called at eof of the channel below.
+ *  - `void finish_output(std::string & out)`: optional, called when the transform gets closed or unstacked.
+ *
+ * The transform is readable if Impl has `input` & writable if it has `output`. Data that doesn't complete
+ * a message yet, e.g. half a frame, needs to be kept by Impl until the next call.
+ * If a non-blocking channel below can't take all of the output, the rest gets written when tcl retries,
+ * so `output` still sees every chunk of data once.
+ *
+ * Use `create_transform` to create it.
+ */
+template<typename Impl>
+struct transform_channel
+{
+  constexpr static int mask = detail::transform_mask<Impl>(detail::rank<1>{})
+                            | detail::transform_output_mask<Impl>(detail::rank<1>{});
+  static_assert(mask != 0, "a transform needs an input or output function");
+
+  transform_channel(const transform_channel &) = delete;
+
+  ~transform_channel()
+  {
+    if (timer_ != nullptr)
+      Tcl_DeleteTimerHandler(timer_);
+  }
+
+  Impl & impl() {return impl_;}
+  /// The channel this transform is stacked on, i.e. the topmost one when it got created.
+  Tcl_Channel parent() const {return parent_;}
+
+  int input(char *buf, int to_read, int &error)
+  {
+    if constexpr ((mask & TCL_READABLE) == 0)
+    {
+      error = EBADF;
+      return -1;
+    }
+    else
+      return input_(buf, to_read, error);
+  }
+
+  int output(const char *buf, int to_write, int &error)
+  {
+    if constexpr ((mask & TCL_WRITABLE) == 0)
+    {
+      error = EBADF;
+      return -1;
+    }
+    else
+    {
+      const auto data = boost::span<const char>(buf, static_cast<std::size_t>(to_write));
+      // tcl retries the same data after EAGAIN, which is already encoded & only needs to be written.
+      const bool retry = out_pos_ < out_.size()
+                      && std::equal(data.begin(), data.end(), retry_.begin(), retry_.end());
+      if (!retry)
+      {
+        // whatever is left of other data goes first
+        if (!write_(error))
+          return -1;
+        out_.clear();
+        out_pos_ = 0u;
+        impl_.output(data, out_);
+      }
+
+      // the data only counts as written once all of its encoding got handed to the channel below
+      if (!write_(error))
+      {
+        if (!retry)
+          retry_.assign(buf, static_cast<std::size_t>(to_write));
+        return -1;
+      }
+      retry_.clear();
+      return to_write;
+    }
+  }
+
+  int seek(Tcl_WideInt, int, int &error)
+  {
+    error = EINVAL;
+    return -1;
+  }
+
+  int set_option(Tcl_Interp *interp, const char *name, const char * value)
+  {
+    if (auto proc = Tcl_ChannelSetOptionProc(Tcl_GetChannelType(parent_)))
+      return proc(Tcl_GetChannelInstanceData(parent_), interp, name, value);
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  int get_option(Tcl_Interp *interp, const char *name, Tcl_DString & string)
+  {
+    if (auto proc = Tcl_ChannelGetOptionProc(Tcl_GetChannelType(parent_)))
+      return proc(Tcl_GetChannelInstanceData(parent_), interp, name, &string);
+    if (name == nullptr)
+      return TCL_OK;
+    return Tcl_BadChannelOption(interp, name, "");
+  }
+
+  void watch(int mask)
+  {
+    // events come from the channel below, through handler
+    Tcl_ChannelWatchProc(Tcl_GetChannelType(parent_))(Tcl_GetChannelInstanceData(parent_), mask);
+
+    // input that's already transformed won't show up there.
+    if ((mask & TCL_READABLE) && in_pos_ < in_.size() && timer_ == nullptr)
+      timer_ = Tcl_CreateTimerHandler(0, &notify_, this);
+    else if ((mask & TCL_READABLE) == 0 && timer_ != nullptr)
+    {
+      Tcl_DeleteTimerHandler(timer_);
+      timer_ = nullptr;
+    }
+  }
+
+  int close(Tcl_Interp *, int flags)
+  {
+    if (flags != 0)
+      return EINVAL;
+    int error = 0;
+    if constexpr ((mask & TCL_WRITABLE) != 0)
+    {
+      out_.erase(0u, out_pos_);
+      out_pos_ = 0u;
+      detail::transform_finish_output(impl_, out_, detail::rank<1>{});
+      write_(error);
+    }
+    delete this;
+    return error;
+  }
+
+  int block_mode(bool blocking)
+  {
+    if (auto proc = Tcl_ChannelBlockModeProc(Tcl_GetChannelType(parent_)))
+      return proc(Tcl_GetChannelInstanceData(parent_), blocking ? TCL_MODE_BLOCKING : TCL_MODE_NONBLOCKING);
+    return 0;
+  }
+
+  int handler(int interest_mask)
+  {
+    // the channel below has data, so the timer isn't needed.
+    if ((interest_mask & TCL_READABLE) && timer_ != nullptr)
+    {
+      Tcl_DeleteTimerHandler(timer_);
+      timer_ = nullptr;
+    }
+    return interest_mask;
+  }
+
+ private:
+  template<typename I, typename ... Args>
+  friend Tcl_Channel create_transform(Tcl_Interp * interp, Tcl_Channel chan, Args && ... args);
+
+  // Tcl_StackChannel stacks on top of whatever is already stacked on parent, which might be the bottom channel.
+  template<typename ... Args>
+  explicit transform_channel(Tcl_Channel parent, Args && ... args)
+      : impl_(std::forward<Args>(args)...), parent_(Tcl_GetTopChannel(parent)),
+        raw_(static_cast<std::size_t>(Tcl_GetChannelBufferSize(parent)))
+  {
+  }
+
+  int input_(char *buf, int to_read, int &error)
+  {
+    while (in_pos_ == in_.size() && !eof_)
+    {
+      in_.clear();
+      in_pos_ = 0u;
+      const int n = Tcl_ReadRaw(parent_, raw_.data(), static_cast<int>(raw_.size()));
+      if (n < 0)
+      {
+        // includes EAGAIN if the channel below is non-blocking
+        error = Tcl_GetErrno();
+        return -1;
+      }
+      if (n > 0)
+        impl_.input(boost::span<const char>(raw_.data(), static_cast<std::size_t>(n)), in_);
+      else if (Tcl_Eof(parent_))
+      {
+        eof_ = true;
+        detail::transform_finish_input(impl_, in_, detail::rank<1>{});
+      }
+      else
+      {
+        error = EAGAIN;
+        return -1;
+      }
+    }
+
+    const auto n = (std::min)(static_cast<std::size_t>(to_read), in_.size() - in_pos_);
+    std::memcpy(buf, in_.data() + in_pos_, n);
+    in_pos_ += n;
+    return static_cast<int>(n);
+  }
+
+  // writes what's left of out_, a non-blocking channel below might only take a part of it.
+  bool write_(int & error)
+  {
+    while (out_pos_ < out_.size())
+    {
+      const int n = Tcl_WriteRaw(parent_, out_.data() + out_pos_, static_cast<int>(out_.size() - out_pos_));
+      if (n < 0)
+      {
+        error = Tcl_GetErrno();
+        return false;
+      }
+      if (n == 0)
+      {
+        error = EAGAIN;
+        return false;
+      }
+      out_pos_ += static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  static void notify_(ClientData data)
+  {
+    auto & this_ = *static_cast<transform_channel*>(data);
+    this_.timer_ = nullptr;
+    // might close the channel & delete this_
+    Tcl_NotifyChannel(this_.channel_, TCL_READABLE);
+  }
+
+  Impl impl_;
+  Tcl_Channel parent_;
+  Tcl_Channel channel_ = nullptr;
+  Tcl_TimerToken timer_ = nullptr;
+  std::vector<char> raw_;
+  // transformed input & how much of it has been read
+  std::string in_;
+  std::size_t in_pos_ = 0u;
+  // transformed output & how much of it has been written, and the data it came from if that's not done yet.
+  std::string out_;
+  std::size_t out_pos_ = 0u;
+  std::string retry_;
+  bool eof_ = false;
+};
+
+template<typename Impl>
+auto tag_invoke(detail::get_class_name_tag<transform_channel<Impl>>) -> boost::core::string_view
+{
+  return tag_invoke(detail::get_class_name_tag<Impl>{});
+}
+
+/** Stack a transform constructed from `args` on top of chan.
+ *
+ * The transform takes over the name of chan, so scripts keep using the same channel; closing it
+ * closes chan too, `chan pop` removes only the transform. Returns null & leaves an error in interp on failure.
+ *
+ * @code
+ * struct line_counter
+ * {
+ *   std::size_t lines = 0;
+ *   void input(boost::span<const char> raw, std::string & out)
+ *   {
+ *     lines += std::count(raw.begin(), raw.end(), '\n');
+ *     out.append(raw.data(), raw.size());
+ *   }
+ * };
+ *
+ * tcl::create_transform<line_counter>(interp, Tcl_GetChannel(interp, "sock0", nullptr));
+ * @endcode
+ */
+template<typename Impl, typename ... Args>
+Tcl_Channel create_transform(Tcl_Interp * interp, Tcl_Channel chan, Args && ... args)
+{
+  using impl_t = transform_channel<Impl>;
+  auto impl = new impl_t(chan, std::forward<Args>(args)...);
+  impl->channel_ = Tcl_StackChannel(interp, &detail::channel_type<impl_t>, impl,
+                                    Tcl_GetChannelMode(chan) & impl_t::mask, chan);
+  if (impl->channel_ == nullptr)
+  {
+    delete impl;
+    return nullptr;
+  }
+  return impl->channel_;
+}
+
+/// The topmost `transform_channel<Impl>` stacked on chan, or null if there is none.
+template<typename Impl>
+transform_channel<Impl> * get_transform(Tcl_Channel chan)
+{
+  // Tcl_GetChannel returns the bottom of the stack
+  for (chan = chan ? Tcl_GetTopChannel(chan) : nullptr; chan != nullptr; chan = Tcl_GetStackedChannel(chan))
+    if (Tcl_GetChannelType(chan) == &detail::channel_type<transform_channel<Impl>>)
+      return static_cast<transform_channel<Impl>*>(Tcl_GetChannelInstanceData(chan));
+  return nullptr;
+}
+
+}
+
+#endif //METAL_TCL_TRANSFORM_HPP
@@ -13,6 +13,13 @@
 #include <metal/tcl/exception.hpp>
 #include <metal/tcl/interpreter.hpp>
 
+#include <boost/core/span.hpp>
+
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 namespace metal::tcl
 {
 
@@ -277,6 +284,274 @@ bool unset(const interpreter_ptr &  interp,
   return unset(interp.get(), name, key, global_only);
 }
 
+namespace detail
+{
+
+// the implementations of the ensembles used for bulk transfers, so they work if `array` got replaced.
+enum class bulk_command {array_set, array_get, namespace_eval};
+
+// a new object per call: tcl caches the resolved command in it, which must not be shared across interpreters or threads.
+inline object_ptr get_bulk_command(bulk_command cmd)
+{
+  constexpr const char * names[3] = {"::tcl::array::set", "::tcl::array::get", "::tcl::namespace::eval"};
+  return object_ptr{Tcl_NewStringObj(names[static_cast<int>(cmd)], -1)};
+}
+
+}
+
+/** Set all elements of a map as elements of an array in one go.
+ *
+ * The array gets looked up once, existing elements that aren't in the map are kept.
+ */
+template<typename Container>
+void set_array(Tcl_Interp * interp,
+               const char * name,
+               const Container & values,
+               bool global_only = false)
+{
+  std::vector<Tcl_Obj*> elems;
+  elems.reserve(values.size() * 2u);
+  for (const auto & [key, value] : values)
+  {
+    elems.push_back(make_object(interp, key).detach());
+    elems.push_back(make_object(interp, value).detach());
+  }
+
+  object_ptr list{Tcl_NewListObj(0, nullptr)};
+  // the list takes its own references
+  Tcl_ListObjReplace(interp, list.get(), 0, 0, static_cast<int>(elems.size()), elems.data());
+  for (auto e : elems)
+    Tcl_DecrRefCount(e);
+
+  object_ptr var_name{Tcl_NewStringObj(name, -1)};
+  auto ensemble = detail::get_bulk_command(detail::bulk_command::array_set);
+  Tcl_Obj * objv[3] = {ensemble.get(), var_name.get(), list.get()};
+  if (Tcl_EvalObjv(interp, 3, objv, global_only ? TCL_EVAL_GLOBAL : 0) != TCL_OK)
+    throw_result(interp);
+  Tcl_ResetResult(interp);
+}
+
+/// Get all elements of an array in one go, converted into a map like container. A missing array has no elements.
+template<typename Container>
+Container get_array(Tcl_Interp * interp,
+                    const char * name,
+                    bool global_only = false)
+{
+  object_ptr var_name{Tcl_NewStringObj(name, -1)};
+  auto ensemble = detail::get_bulk_command(detail::bulk_command::array_get);
+  Tcl_Obj * objv[2] = {ensemble.get(), var_name.get()};
+  if (Tcl_EvalObjv(interp, 2, objv, global_only ? TCL_EVAL_GLOBAL : 0) != TCL_OK)
+    throw_result(interp);
+
+  object_ptr list = Tcl_GetObjResult(interp);
+  Tcl_ResetResult(interp);
+
+  int objc = 0;
+  Tcl_Obj ** elems = nullptr;
+  if (Tcl_ListObjGetElements(interp, list.get(), &objc, &elems) != TCL_OK)
+    throw_result(interp);
+
+  Container res;
+  for (int i = 0; i + 1 < objc; i += 2)
+    res.emplace(cast<typename Container::key_type>(interp, elems[i]),
+                cast<typename Container::mapped_type>(interp, elems[i + 1]));
+  return res;
+}
+
+/** Set many variables of a namespace, e.g. `{{"x", 1}, {"y", 2}}`.
+ *
+ * All variables get set by a single `variable` command, evaluated in the namespace.
+ * Passing `"::"` sets global variables.
+ */
+template<typename Container>
+void set_many(Tcl_Interp * interp,
+              const char * namespace_,
+              const Container & values)
+{
+  auto ns = Tcl_FindNamespace(interp, namespace_, nullptr, TCL_LEAVE_ERR_MSG);
+  if (ns == nullptr)
+    throw_result(interp);
+
+  object_ptr cmd{Tcl_NewListObj(0, nullptr)};
+  Tcl_ListObjAppendElement(interp, cmd.get(), Tcl_NewStringObj("::variable", -1));
+  for (const auto & [key, value] : values)
+  {
+    Tcl_ListObjAppendElement(interp, cmd.get(), make_object(interp, key).get());
+    Tcl_ListObjAppendElement(interp, cmd.get(), make_object(interp, value).get());
+  }
+
+  // a pure list gets evaluated without parsing
+  object_ptr ns_name{Tcl_NewStringObj(ns->fullName, -1)};
+  auto ensemble = detail::get_bulk_command(detail::bulk_command::namespace_eval);
+  Tcl_Obj * objv[3] = {ensemble.get(), ns_name.get(), cmd.get()};
+  if (Tcl_EvalObjv(interp, 3, objv, 0) != TCL_OK)
+    throw_result(interp);
+  Tcl_ResetResult(interp);
+}
+
+template<typename Container>
+void set_array(const interpreter_ptr & interp,
+               const char * name,
+               const Container & values,
+               bool global_only = false)
+{
+  set_array(interp.get(), name, values, global_only);
+}
+
+template<typename Container>
+Container get_array(const interpreter_ptr & interp,
+                    const char * name,
+                    bool global_only = false)
+{
+  return get_array<Container>(interp.get(), name, global_only);
+}
+
+template<typename Container>
+void set_many(const interpreter_ptr & interp,
+              const char * namespace_,
+              const Container & values)
+{
+  set_many(interp.get(), namespace_, values);
+}
+
+/** A handle to a global or namespace variable, that caches its value.
+ *
+ * The names are converted into objects once, and a trace invalidates the cached value whenever
+ * the variable gets written or unset. Reading a variable that didn't change since the last access
+ * does no lookup at all. Writing a value that nothing but the variable refers to updates the object in place,
+ * so it doesn't allocate; the write still goes through `Tcl_ObjSetVar2`, so other traces see it.
+ *
+ * The handle survives the variable getting unset and re-created. It must not outlive the interpreter.
+ *
+ * Read traces are skipped by the cache: they only run when the value gets fetched after a write or unset,
+ * not on every `get`. So don't use it for variables whose value gets produced by a read trace,
+ * e.g. ones created with `link` or `Tcl_LinkVar`, or when a read trace needs to see every read,
+ * e.g. one added by `trace add variable name read`.
+ *
+ * @code
+ * tcl::var_ref<double> setpoint{interp, "ctrl::setpoint"};
+ * tcl::var_ref<double> output{interp, "ctrl::output"};
+ * output = pid.step(setpoint.get());
+ * @endcode
+ */
+template<typename T>
+struct var_ref
+{
+  var_ref(Tcl_Interp * interp, const char * name)
+      : interp_(interp), name_(Tcl_NewStringObj(name, -1))
+  {
+    trace_();
+  }
+
+  var_ref(Tcl_Interp * interp, const char * name, const char * key)
+      : interp_(interp), name_(Tcl_NewStringObj(name, -1)), key_(Tcl_NewStringObj(key, -1))
+  {
+    trace_();
+  }
+
+  var_ref(const interpreter_ptr & interp, const char * name) : var_ref(interp.get(), name) {}
+  var_ref(const interpreter_ptr & interp, const char * name, const char * key) : var_ref(interp.get(), name, key) {}
+
+  var_ref(const var_ref & ) = delete;
+  var_ref& operator=(const var_ref & ) = delete;
+
+  ~var_ref()
+  {
+    if (traced_)
+      Tcl_UntraceVar2(interp_, Tcl_GetString(name_.get()), key_ ? Tcl_GetString(key_.get()) : nullptr,
+                      trace_flags, &trace_proc_, this);
+  }
+
+  /// Get the value, throws if the variable doesn't exist.
+  T get()
+  {
+    auto p = value_(TCL_LEAVE_ERR_MSG);
+    if (!p)
+      throw_result(interp_);
+    return cast<T>(interp_, p);
+  }
+
+  std::optional<T> try_get()
+  {
+    auto p = value_(0);
+    if (!p)
+      return std::nullopt;
+    return cast<T>(interp_, p);
+  }
+
+  void set(const T & value)
+  {
+    if (!traced_)
+      trace_();
+
+    object_ptr obj;
+    // the variable holds the only reference, so its object can be reused.
+    if (cached_ && !Tcl_IsShared(cached_) && detail::assign_in_place(cached_, value))
+      obj = cached_;
+    else
+      obj = make_object(interp_, value);
+
+    auto res = Tcl_ObjSetVar2(interp_, name_.get(), key_.get(), obj.get(), TCL_GLOBAL_ONLY | TCL_LEAVE_ERR_MSG);
+    if (!res)
+      throw_result(interp_);
+    // our trace invalidated the cache, res is the value after all traces ran.
+    cached_ = res;
+  }
+
+  var_ref & operator=(const T & value)
+  {
+    set(value);
+    return *this;
+  }
+
+  bool unset()
+  {
+    cached_ = nullptr;
+    return Tcl_UnsetVar2(interp_, Tcl_GetString(name_.get()), key_ ? Tcl_GetString(key_.get()) : nullptr,
+                         TCL_GLOBAL_ONLY) == TCL_OK;
+  }
+
+  Tcl_Interp * interpreter() const {return interp_;}
+
+ private:
+  constexpr static int trace_flags = TCL_GLOBAL_ONLY | TCL_TRACE_WRITES | TCL_TRACE_UNSETS;
+
+  // the trace of an unset variable is gone, so it gets added again on the next access.
+  void trace_()
+  {
+    traced_ = Tcl_TraceVar2(interp_, Tcl_GetString(name_.get()), key_ ? Tcl_GetString(key_.get()) : nullptr,
+                            trace_flags, &trace_proc_, this) == TCL_OK;
+  }
+
+  Tcl_Obj * value_(int flags)
+  {
+    if (cached_)
+      return cached_;
+    if (!traced_)
+      trace_();
+    // only cache if the trace is in place, so it gets invalidated.
+    auto p = Tcl_ObjGetVar2(interp_, name_.get(), key_.get(), TCL_GLOBAL_ONLY | flags);
+    if (traced_)
+      cached_ = p;
+    return p;
+  }
+
+  static char * trace_proc_(ClientData clientData, Tcl_Interp *, const char *, const char *, int flags)
+  {
+    auto & this_ = *static_cast<var_ref*>(clientData);
+    this_.cached_ = nullptr;
+    if (flags & TCL_TRACE_DESTROYED)
+      this_.traced_ = false;
+    return nullptr;
+  }
+
+  Tcl_Interp * interp_;
+  object_ptr name_, key_;
+  bool traced_ = false;
+  // the value object of the variable, the variable holds the reference.
+  Tcl_Obj * cached_ = nullptr;
+};
+
 template<typename Impl>
 struct tracer
 {
@@ -342,6 +617,199 @@ tracer(Impl &&, Tcl_Interp *, const char *, int) -> tracer<std::decay_t<Impl>>;
 template<typename Impl>
 tracer(Impl &&, Tcl_Interp *, const char *, const char *, int) -> tracer<std::decay_t<Impl>>;
 
+/// When a `batch_tracer` delivers the changes it collected.
+enum class batch_mode
+{
+  /// From an idle callback, i.e. once the event loop has nothing else to do.
+  idle,
+  /// From an event, i.e. in the next iteration of the event loop.
+  event,
+  /// Only when `flush` gets called.
+  manual
+};
+
+/** A tracer that collects the changes of a variable and reports them at once.
+ *
+ * The trace only records which variable or array elements changed, so writing a variable in a loop
+ * invokes the callback once per batch, not once per write. The changes get delivered according to the `batch_mode`,
+ * or by calling `flush`, by invoking `impl(interp, name, keys)`, where `keys` is a `boost::span<const std::string>`
+ * of the array elements that changed, each once. `keys` is empty if the variable itself was written or unset.
+ * Exceptions thrown by `impl` when it gets called from the event loop become background errors.
+ *
+ * @code
+ * tcl::batch_tracer tr{
+ *   [](Tcl_Interp *, const char * name, boost::span<const std::string> keys) { redraw(keys); },
+ *   interp, "model", tcl::batch_mode::idle};
+ * @endcode
+ */
+template<typename Impl>
+struct batch_tracer
+{
+  batch_tracer(const batch_tracer & ) = delete;
+
+  template<typename Impl_>
+  batch_tracer(Impl_ && impl, Tcl_Interp * interp, const char * name, batch_mode mode = batch_mode::idle,
+               int flags = TCL_TRACE_WRITES | TCL_TRACE_UNSETS)
+      : name(name), mode(mode), flags(flags | TCL_GLOBAL_ONLY), interp(interp), impl_(std::forward<Impl_>(impl))
+  {
+    if (!trace_())
+      throw_result(interp);
+  }
+
+  ~batch_tracer()
+  {
+    if (traced_)
+      Tcl_UntraceVar2(interp, name.c_str(), nullptr, flags, &proc_impl_, this);
+    unschedule_();
+  }
+
+  /// Whether there are changes that haven't been delivered.
+  bool pending() const {return whole_ || !keys_.empty();}
+
+  /// Deliver the collected changes now, does nothing if there are none.
+  void flush()
+  {
+    unschedule_();
+    if (!pending())
+      return;
+
+    // the callback may write the variable again, which starts a new batch.
+    delivered_.assign(std::make_move_iterator(keys_.begin()), std::make_move_iterator(keys_.end()));
+    keys_.clear();
+    if (whole_)
+      delivered_.clear();
+    whole_ = false;
+
+    impl_(interp, name.c_str(), boost::span<const std::string>(delivered_.data(), delivered_.size()));
+  }
+
+  const std::string name;
+  const batch_mode mode;
+  const int flags;
+  Tcl_Interp * const interp;
+
+ private:
+  struct flush_event : Tcl_Event
+  {
+    batch_tracer * tracer;
+  };
+
+  bool trace_()
+  {
+    traced_ = Tcl_TraceVar2(interp, name.c_str(), nullptr, flags, &proc_impl_, this) == TCL_OK;
+    return traced_;
+  }
+
+  void schedule_()
+  {
+    if (scheduled_ || mode == batch_mode::manual)
+      return;
+    scheduled_ = true;
+    if (mode == batch_mode::idle)
+      Tcl_DoWhenIdle(&idle_proc_, this);
+    else
+    {
+      auto ev = static_cast<flush_event*>(static_cast<void*>(Tcl_Alloc(sizeof(flush_event))));
+      ev->proc = &event_proc_;
+      ev->nextPtr = nullptr;
+      ev->tracer = this;
+      Tcl_QueueEvent(ev, TCL_QUEUE_TAIL);
+    }
+  }
+
+  void unschedule_()
+  {
+    if (!scheduled_)
+      return;
+    scheduled_ = false;
+    if (mode == batch_mode::idle)
+      Tcl_CancelIdleCall(&idle_proc_, this);
+    else
+      Tcl_DeleteEvents(+[](Tcl_Event * ev, ClientData self)
+                       {
+                         return (ev->proc == &event_proc_ && static_cast<flush_event*>(ev)->tracer == self) ? 1 : 0;
+                       }, this);
+  }
+
+  // called from the event loop, so exceptions can't propagate & become background errors instead.
+  void flush_from_loop_() noexcept
+  {
+    scheduled_ = false;
+    try
+    {
+      flush();
+    }
+    catch (...)
+    {
+      Tcl_SetObjResult(interp, make_exception_object().get());
+      Tcl_BackgroundException(interp, TCL_ERROR);
+    }
+  }
+
+  static void idle_proc_(ClientData clientData)
+  {
+    static_cast<batch_tracer*>(clientData)->flush_from_loop_();
+  }
+
+  static int event_proc_(Tcl_Event * ev, int)
+  {
+    static_cast<flush_event*>(ev)->tracer->flush_from_loop_();
+    return 1;
+  }
+
+  static char * proc_impl_(
+      ClientData clientData,
+      Tcl_Interp *,
+      const char *,
+      const char * name2,
+      int flags) noexcept
+  {
+    auto & this_ = *static_cast<batch_tracer*>(clientData);
+    if (flags & TCL_INTERP_DESTROYED)
+    {
+      this_.traced_ = false;
+      return nullptr;
+    }
+
+    if (name2 == nullptr)
+    {
+      this_.whole_ = true;
+      this_.keys_.clear();
+    }
+    else if (!this_.whole_)
+    {
+      // reuses the buffer, so keys that are already dirty don't allocate.
+      this_.scratch_.assign(name2);
+      if (this_.keys_.find(this_.scratch_) == this_.keys_.end())
+        this_.keys_.insert(this_.scratch_);
+    }
+
+    // the trace is gone with the variable, but the tracer keeps watching the name.
+    if (flags & TCL_TRACE_DESTROYED)
+      this_.trace_();
+
+    this_.schedule_();
+    return nullptr;
+  }
+
+  Impl impl_;
+  bool traced_ = false;
+  bool scheduled_ = false;
+  bool whole_ = false;
+  std::string scratch_;
+  std::unordered_set<std::string> keys_;
+  std::vector<std::string> delivered_;
+};
+
+template<typename Impl>
+batch_tracer(Impl &&, Tcl_Interp *, const char *) -> batch_tracer<std::decay_t<Impl>>;
+
+template<typename Impl>
+batch_tracer(Impl &&, Tcl_Interp *, const char *, batch_mode) -> batch_tracer<std::decay_t<Impl>>;
+
+template<typename Impl>
+batch_tracer(Impl &&, Tcl_Interp *, const char *, batch_mode, int) -> batch_tracer<std::decay_t<Impl>>;
+
 
 }
 
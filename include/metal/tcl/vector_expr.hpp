@@ -0,0 +1,437 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef METAL_TCL_VECTOR_EXPR_HPP
+#define METAL_TCL_VECTOR_EXPR_HPP
+
+#include <tcl.h>
+#include <metal/tcl/builtin/float.hpp>
+#include <metal/tcl/expr.hpp>
+#include <metal/tcl/interpreter.hpp>
+#include <metal/tcl/object.hpp>
+#include <metal/tcl/parse.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/core/detail/string_view.hpp>
+#include <boost/core/span.hpp>
+#include <boost/system/result.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+namespace metal::tcl
+{
+
+namespace detail
+{
+
+// A numeric expression compiled into a list of instructions, each of which operates on a whole batch of rows.
+struct vector_program
+{
+  constexpr static std::size_t batch_size = 256u;
+
+  enum class op : unsigned char
+  {
+    neg, not_, add, sub, mul, div, pow, lt, gt, le, ge, eq, ne, and_, or_, select,
+    sqrt, exp, log, log10, sin, cos, tan, asin, acos, atan, sinh, cosh, tanh,
+    abs, floor, ceil, round, double_, atan2, hypot, fmod, min, max
+  };
+
+  struct operand
+  {
+    enum kind_t : unsigned char {none, column, constant, reg} kind = none;
+    std::uint32_t index = 0u;
+  };
+
+  // the result of instruction i is stored in register i.
+  struct instruction
+  {
+    op code;
+    operand a, b, c;
+  };
+
+  std::vector<instruction> code;
+  std::vector<double> constants;
+  operand result;
+};
+
+struct vector_compiler
+{
+  Tcl_Interp * interp;
+  std::initializer_list<boost::core::string_view> columns;
+  vector_program & prog;
+
+  using op = vector_program::op;
+  using operand = vector_program::operand;
+
+  static const Tcl_Token * next_sibling(const Tcl_Token * tk)
+  {
+    return tk + 1 + tk->numComponents;
+  }
+
+  static std::optional<op> lookup(boost::core::string_view name, std::size_t arity)
+  {
+    struct entry {const char * name; std::size_t arity; op code;};
+    // functions are matched by name, i.e. overriding them in tcl::mathfunc is not detected.
+    constexpr static entry table[] = {
+        {"-", 1u, op::neg}, {"!", 1u, op::not_},
+        {"+", 2u, op::add}, {"-", 2u, op::sub}, {"*", 2u, op::mul}, {"/", 2u, op::div}, {"**", 2u, op::pow},
+        {"<", 2u, op::lt}, {">", 2u, op::gt}, {"<=", 2u, op::le}, {">=", 2u, op::ge},
+        {"==", 2u, op::eq}, {"!=", 2u, op::ne}, {"&&", 2u, op::and_}, {"||", 2u, op::or_},
+        {"?", 3u, op::select},
+        {"sqrt", 1u, op::sqrt}, {"exp", 1u, op::exp}, {"log", 1u, op::log}, {"log10", 1u, op::log10},
+        {"sin", 1u, op::sin}, {"cos", 1u, op::cos}, {"tan", 1u, op::tan},
+        {"asin", 1u, op::asin}, {"acos", 1u, op::acos}, {"atan", 1u, op::atan},
+        {"sinh", 1u, op::sinh}, {"cosh", 1u, op::cosh}, {"tanh", 1u, op::tanh},
+        {"abs", 1u, op::abs}, {"floor", 1u, op::floor}, {"ceil", 1u, op::ceil}, {"round", 1u, op::round},
+        {"double", 1u, op::double_},
+        {"pow", 2u, op::pow}, {"atan2", 2u, op::atan2}, {"hypot", 2u, op::hypot}, {"fmod", 2u, op::fmod},
+    };
+
+    for (const auto & e : table)
+      if (e.arity == arity && name == e.name)
+        return e.code;
+    return std::nullopt;
+  }
+
+  operand emit(op code, operand a, operand b = {}, operand c = {})
+  {
+    prog.code.push_back({code, a, b, c});
+    return {operand::reg, static_cast<std::uint32_t>(prog.code.size() - 1u)};
+  }
+
+  // operators & builtin functions that always yield the same result for the same arguments, i.e. not rand or srand.
+  static bool pure(boost::core::string_view name)
+  {
+    constexpr static const char * table[] = {
+        "+", "-", "*", "/", "%", "**", "<<", ">>", "<", ">", "<=", ">=", "==", "!=",
+        "eq", "ne", "in", "ni", "&", "^", "|", "&&", "||", "?", "!", "~",
+        "abs", "acos", "asin", "atan", "atan2", "bool", "ceil", "cos", "cosh", "double", "entier", "exp",
+        "floor", "fmod", "hypot", "int", "isqrt", "log", "log10", "max", "min", "pow", "round",
+        "sin", "sinh", "sqrt", "tan", "tanh", "wide"
+    };
+    return std::find(std::begin(table), std::end(table), name) != std::end(table);
+  }
+
+  // anything that doesn't depend on a column gets evaluated by tcl, so integer arithmetic keeps its semantics.
+  // only pure sub-expressions can be folded, anything else, e.g. `rand()` or a proc in tcl::mathfunc, needs to be
+  // evaluated per row, so that makes the whole expression run through tcl.
+  std::optional<operand> fold(const Tcl_Token * tk)
+  {
+    if (!std::all_of(tk + 1, next_sibling(tk),
+                     [](const Tcl_Token & t)
+                     {
+                       return t.type != TCL_TOKEN_OPERATOR
+                           || pure(boost::core::string_view{t.start, static_cast<std::size_t>(t.size)});
+                     }))
+      return std::nullopt;
+
+    object_ptr ex = Tcl_NewStringObj(tk->start, tk->size);
+    Tcl_Obj * out = nullptr;
+
+    auto st = Tcl_SaveInterpState(interp, TCL_OK);
+    const auto res = Tcl_ExprObj(interp, ex.get(), &out);
+    Tcl_RestoreInterpState(interp, st);
+    if (res != TCL_OK)
+      return std::nullopt;
+
+    object_ptr value{out, false};
+    double d;
+    if (Tcl_GetDoubleFromObj(nullptr, value.get(), &d) != TCL_OK)
+      return std::nullopt;
+
+    prog.constants.push_back(d);
+    return operand{operand::constant, static_cast<std::uint32_t>(prog.constants.size() - 1u)};
+  }
+
+  std::optional<operand> compile(const Tcl_Token * tk)
+  {
+    BOOST_ASSERT(tk->type == TCL_TOKEN_SUB_EXPR);
+    const auto end = next_sibling(tk);
+
+    if (std::none_of(tk + 1, end,
+                     [](const Tcl_Token & t) {return t.type == TCL_TOKEN_VARIABLE || t.type == TCL_TOKEN_COMMAND;}))
+      return fold(tk);
+
+    const auto first = tk + 1;
+    if (first->type == TCL_TOKEN_VARIABLE)
+    {
+      // only plain scalars, `$a` or `${a}`
+      if (first->numComponents != 1 || tk->numComponents != 2)
+        return std::nullopt;
+
+      const boost::core::string_view name{first[1].start, static_cast<std::size_t>(first[1].size)};
+      const auto itr = std::find(columns.begin(), columns.end(), name);
+      if (itr == columns.end())
+        return std::nullopt;
+      return operand{operand::column, static_cast<std::uint32_t>(itr - columns.begin())};
+    }
+
+    if (first->type != TCL_TOKEN_OPERATOR)
+      return std::nullopt;
+
+    const boost::core::string_view name{first->start, static_cast<std::size_t>(first->size)};
+    std::vector<operand> args;
+    for (auto arg = first + 1; arg < end; arg = next_sibling(arg))
+    {
+      auto o = compile(arg);
+      if (!o)
+        return std::nullopt;
+      args.push_back(*o);
+    }
+
+    if (name == "+" && args.size() == 1u)
+      return args.front();
+
+    if ((name == "min" || name == "max") && !args.empty())
+    {
+      auto res = args.front();
+      for (auto itr = args.begin() + 1; itr != args.end(); itr++)
+        res = emit(name == "min" ? op::min : op::max, res, *itr);
+      // single argument still needs the nan check.
+      return args.size() == 1u ? emit(op::double_, res) : res;
+    }
+
+    const auto code = lookup(name, args.size());
+    if (!code)
+      return std::nullopt;
+
+    args.resize(3u);
+    return emit(*code, args[0], args[1], args[2]);
+  }
+};
+
+}
+
+/** A numeric expression that gets evaluated natively over columns of doubles.
+ *
+ * The expression gets compiled into a program that runs over batches of rows, i.e. the inner loops
+ * are plain loops over arrays the compiler can vectorize. Supported are arithmetic, comparisons, logical operators,
+ * the ternary operator & the floating-point math functions, on variables that name a column.
+ * Sub-expressions that don't use any column & only use pure operators & functions are evaluated by tcl once.
+ *
+ * Anything else (commands, strings, other variables, integer only operators like `%`, functions like `rand()`
+ * or ones defined in `tcl::mathfunc`) makes the whole expression
+ * run through tcl row by row. Rows that produce a NaN are handed to tcl too, which either yields a value or the error
+ * tcl would report, so the results are the same as with `expr`.
+ *
+ * @code
+ * tcl::vector_expr ex{interp, "$price * $qty > 100 ? $price * 0.9 : $price", {"price", "qty"}};
+ * ex.evaluate({prices, quantities}, out).value();
+ * @endcode
+ */
+struct vector_expr
+{
+  vector_expr(Tcl_Interp * interp,
+              boost::core::string_view expression,
+              std::initializer_list<boost::core::string_view> columns)
+      : fallback_(interp, expression), columns_(columns.size())
+  {
+    for (auto c : columns)
+      fallback_.declare(c);
+
+    parse_result pr;
+    if (!parse_expr(interp, pr, expression))
+      return;
+
+    detail::vector_program prog;
+    detail::vector_compiler comp{interp, columns, prog};
+    auto res = comp.compile(pr.tokens().data());
+    if (!res)
+      return;
+
+    prog.result = *res;
+    program_ = std::move(prog);
+
+    constexpr auto bs = detail::vector_program::batch_size;
+    constants_.resize(program_->constants.size() * bs);
+    for (std::size_t i = 0u; i < program_->constants.size(); i++)
+      std::fill_n(constants_.data() + i * bs, bs, program_->constants[i]);
+    registers_.resize(program_->code.size() * bs);
+  }
+
+  vector_expr(const interpreter_ptr & interp,
+              boost::core::string_view expression,
+              std::initializer_list<boost::core::string_view> columns)
+      : vector_expr(interp.get(), expression, columns)
+  {
+  }
+
+  /// Whether the expression gets evaluated natively or row by row through tcl.
+  bool native() const {return program_.has_value();}
+
+  /// Evaluate the expression for every row, the columns are passed in the order they were declared in.
+  result<void> evaluate(std::initializer_list<boost::span<const double>> columns, boost::span<double> out)
+  {
+    BOOST_ASSERT(columns.size() == columns_);
+    for (auto & c : columns)
+      BOOST_ASSERT(c.size() == out.size());
+    (void)columns_;
+
+    if (!program_)
+      return evaluate_tcl_(columns, out, 0u, out.size(), nullptr);
+
+    constexpr auto bs = detail::vector_program::batch_size;
+    for (std::size_t offset = 0u; offset < out.size(); offset += bs)
+    {
+      const auto n = (std::min)(bs, out.size() - offset);
+      run_(columns, offset, n, out.data() + offset);
+
+      auto res = evaluate_tcl_(columns, out, offset, n, bad_);
+      if (res.has_error())
+        return res;
+    }
+    return boost::system::in_place_value;
+  }
+
+  result<void> evaluate(std::initializer_list<boost::span<const double>> columns, std::vector<double> & out)
+  {
+    out.resize(columns.size() == 0u ? 0u : columns.begin()->size());
+    return evaluate(columns, boost::span<double>(out));
+  }
+
+ private:
+  using op = detail::vector_program::op;
+  using operand = detail::vector_program::operand;
+
+  const double * load_(std::initializer_list<boost::span<const double>> columns,
+                       std::size_t offset, operand o) const
+  {
+    constexpr auto bs = detail::vector_program::batch_size;
+    switch (o.kind)
+    {
+      case operand::column:   return columns.begin()[o.index].data() + offset;
+      case operand::constant: return constants_.data() + o.index * bs;
+      case operand::reg:      return registers_.data() + o.index * bs;
+      default:                return nullptr;
+    }
+  }
+
+  template<typename Func>
+  static void map_(std::size_t n, double * d, const double * a, Func f)
+  {
+    for (std::size_t i = 0u; i < n; i++)
+      d[i] = f(a[i]);
+  }
+
+  template<typename Func>
+  static void map_(std::size_t n, double * d, const double * a, const double * b, Func f)
+  {
+    for (std::size_t i = 0u; i < n; i++)
+      d[i] = f(a[i], b[i]);
+  }
+
+  // operators that don't propagate a NaN need to flag the row, so tcl can report the error.
+  void check_nan_(std::size_t n, const double * a)
+  {
+    for (std::size_t i = 0u; i < n; i++)
+      bad_[i] |= std::isnan(a[i]);
+  }
+
+  void run_(std::initializer_list<boost::span<const double>> columns, std::size_t offset, std::size_t n, double * out)
+  {
+    constexpr auto bs = detail::vector_program::batch_size;
+    std::fill_n(bad_, n, false);
+
+    for (std::size_t idx = 0u; idx < program_->code.size(); idx++)
+    {
+      const auto & ins = program_->code[idx];
+      double * d = registers_.data() + idx * bs;
+      const double * a = load_(columns, offset, ins.a);
+      const double * b = load_(columns, offset, ins.b);
+
+      switch (ins.code)
+      {
+        case op::neg:     map_(n, d, a, [](double x) {return -x;}); break;
+        case op::not_:    check_nan_(n, a); map_(n, d, a, [](double x) {return x == 0. ? 1. : 0.;}); break;
+        case op::add:     map_(n, d, a, b, [](double x, double y) {return x + y;}); break;
+        case op::sub:     map_(n, d, a, b, [](double x, double y) {return x - y;}); break;
+        case op::mul:     map_(n, d, a, b, [](double x, double y) {return x * y;}); break;
+        case op::div:     map_(n, d, a, b, [](double x, double y) {return x / y;}); break;
+        case op::pow:     map_(n, d, a, b, [](double x, double y) {return std::pow(x, y);}); break;
+        case op::lt:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x <  y ? 1. : 0.;}); break;
+        case op::gt:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x >  y ? 1. : 0.;}); break;
+        case op::le:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x <= y ? 1. : 0.;}); break;
+        case op::ge:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x >= y ? 1. : 0.;}); break;
+        case op::eq:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x == y ? 1. : 0.;}); break;
+        case op::ne:      check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x != y ? 1. : 0.;}); break;
+        case op::and_:    check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x != 0. && y != 0. ? 1. : 0.;}); break;
+        case op::or_:     check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return x != 0. || y != 0. ? 1. : 0.;}); break;
+        case op::select:
+        {
+          check_nan_(n, a);
+          const double * c = load_(columns, offset, ins.c);
+          for (std::size_t i = 0u; i < n; i++)
+            d[i] = a[i] != 0. ? b[i] : c[i];
+          break;
+        }
+        case op::sqrt:    map_(n, d, a, [](double x) {return std::sqrt(x);}); break;
+        case op::exp:     map_(n, d, a, [](double x) {return std::exp(x);}); break;
+        case op::log:     map_(n, d, a, [](double x) {return std::log(x);}); break;
+        case op::log10:   map_(n, d, a, [](double x) {return std::log10(x);}); break;
+        case op::sin:     map_(n, d, a, [](double x) {return std::sin(x);}); break;
+        case op::cos:     map_(n, d, a, [](double x) {return std::cos(x);}); break;
+        case op::tan:     map_(n, d, a, [](double x) {return std::tan(x);}); break;
+        case op::asin:    map_(n, d, a, [](double x) {return std::asin(x);}); break;
+        case op::acos:    map_(n, d, a, [](double x) {return std::acos(x);}); break;
+        case op::atan:    map_(n, d, a, [](double x) {return std::atan(x);}); break;
+        case op::sinh:    map_(n, d, a, [](double x) {return std::sinh(x);}); break;
+        case op::cosh:    map_(n, d, a, [](double x) {return std::cosh(x);}); break;
+        case op::tanh:    map_(n, d, a, [](double x) {return std::tanh(x);}); break;
+        case op::abs:     map_(n, d, a, [](double x) {return std::fabs(x);}); break;
+        case op::floor:   map_(n, d, a, [](double x) {return std::floor(x);}); break;
+        case op::ceil:    map_(n, d, a, [](double x) {return std::ceil(x);}); break;
+        case op::round:   map_(n, d, a, [](double x) {return std::round(x);}); break;
+        case op::double_: map_(n, d, a, [](double x) {return x;}); break;
+        case op::atan2:   map_(n, d, a, b, [](double x, double y) {return std::atan2(x, y);}); break;
+        case op::hypot:   map_(n, d, a, b, [](double x, double y) {return std::hypot(x, y);}); break;
+        case op::fmod:    map_(n, d, a, b, [](double x, double y) {return std::fmod(x, y);}); break;
+        case op::min:     check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return y < x ? y : x;}); break;
+        case op::max:     check_nan_(n, a); check_nan_(n, b); map_(n, d, a, b, [](double x, double y) {return y > x ? y : x;}); break;
+      }
+    }
+
+    std::copy_n(load_(columns, offset, program_->result), n, out);
+    check_nan_(n, out);
+  }
+
+  // evaluates rows through tcl, either all of them or the ones flagged in `mask`.
+  result<void> evaluate_tcl_(std::initializer_list<boost::span<const double>> columns, boost::span<double> out,
+                             std::size_t offset, std::size_t n, const bool * mask)
+  {
+    for (std::size_t i = 0u; i < n; i++)
+    {
+      if (mask && !mask[i])
+        continue;
+
+      std::size_t idx = 0u;
+      for (auto & c : columns)
+        fallback_.set(idx++, c[offset + i]);
+
+      auto res = fallback_.evaluate<double>();
+      if (res.has_error())
+        return result<void>{boost::system::in_place_error, res.error()};
+      out[offset + i] = *res;
+    }
+    return boost::system::in_place_value;
+  }
+
+  compiled_expr fallback_;
+  std::size_t columns_;
+  std::optional<detail::vector_program> program_;
+  std::vector<double> constants_, registers_;
+  bool bad_[detail::vector_program::batch_size];
+};
+
+}
+
+#endif //METAL_TCL_VECTOR_EXPR_HPP
@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/asio_notifier.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/thread.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+namespace asio = boost::asio;
+
+#if !defined(_WIN32)
+
+// before main, so every thread of this test uses it, including the main one.
+static const bool notifier_installed = (tcl::set_asio_notifier(), true);
+
+static Tcl_Interp * thread_interp = nullptr;
+
+TEST_CASE("asio-notifier")
+{
+  REQUIRE(notifier_installed);
+  // the main thread uses its own io_context
+  CHECK_NOTHROW(tcl::get_io_context());
+
+  CHECK(tcl::eval<int>(interp, "after 10 {set ::an_done 1}; vwait ::an_done; set ::an_done").value() == 1);
+
+  // file handlers
+  CHECK(tcl::eval<std::string>(interp, R"(
+    lassign [chan pipe] r w
+    fconfigure $r -blocking 0
+    fileevent $r readable [list apply {{r} {set ::an_line [gets $r]}} $r]
+    after 10 [list puts $w hello]
+    after 20 [list flush $w]
+    vwait ::an_line
+    close $w
+    close $r
+    set ::an_line)").value() == "hello");
+
+  // asio completions on the main thread's io_context are run by vwait too
+  asio::steady_timer tim{tcl::get_io_context(), std::chrono::milliseconds(10)};
+  tim.async_wait([](boost::system::error_code) {Tcl_SetVar(interp, "::an_asio", "1", TCL_GLOBAL_ONLY);});
+  CHECK(tcl::eval<int>(interp, "vwait ::an_asio; set ::an_asio").value() == 1);
+}
+
+TEST_CASE("asio-notifier-thread")
+{
+  std::atomic<Tcl_ThreadId> id{nullptr};
+  std::atomic<bool> done{false};
+  std::string result;
+
+  tcl::thread thr{
+      [&]
+      {
+        asio::io_context ctx;
+        tcl::use_io_context(ctx);
+        auto ip = Tcl_CreateInterp();
+        CHECK(&tcl::get_io_context() == &ctx);
+
+        // an asio timer and a tcl timer in one loop
+        asio::steady_timer tim{ctx, std::chrono::milliseconds(20)};
+        tim.async_wait([ip](boost::system::error_code) {Tcl_SetVar(ip, "asio", "1", TCL_GLOBAL_ONLY);});
+        CHECK(tcl::eval<bool>(ip, "after 5 {set tcl 1}; vwait asio; info exists tcl").value());
+
+        // woken up by the other thread with Tcl_ThreadAlert
+        thread_interp = ip;
+        id = Tcl_GetCurrentThread();
+        tcl::eval(ip, "vwait from_main").value();
+        result = tcl::eval<std::string>(ip, "set from_main").value();
+
+        // asio drives tcl
+        Tcl_SetServiceMode(TCL_SERVICE_ALL);
+        tcl::eval(ip, "after 10 {set ::from_run 1}").value();
+        ctx.run_for(std::chrono::milliseconds(200));
+        CHECK(tcl::eval<std::string>(ip, "set ::from_run").value() == "1");
+        Tcl_SetServiceMode(TCL_SERVICE_NONE);
+
+        Tcl_DeleteInterp(ip);
+        Tcl_FinalizeThread();
+        done = true;
+      }};
+
+  while (id.load() == nullptr)
+    std::this_thread::yield();
+
+  // runs in the thread
+  auto ev = reinterpret_cast<Tcl_Event*>(Tcl_Alloc(sizeof(Tcl_Event)));
+  ev->proc = +[](Tcl_Event *, int)
+  {
+    Tcl_SetVar(thread_interp, "from_main", "hello", TCL_GLOBAL_ONLY);
+    return 1;
+  };
+  Tcl_ThreadQueueEvent(id.load(), ev, TCL_QUEUE_TAIL);
+  Tcl_ThreadAlert(id.load());
+
+  thr.join();
+  CHECK(done);
+  CHECK(result == "hello");
+}
+
+#endif
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/ast.hpp>
+
+#include "doctest.h"
+
+#include <string>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+using kind = tcl::ast::node_kind;
+
+TEST_CASE("ast")
+{
+  std::string script = "# comment\nset x [expr {$a + 1}]; puts \"v: $arr(k\\n) [list a]\"\n{*}$cmd {foo bar} {puts [a]}";
+  auto res = tcl::parse_ast(interp, script);
+  REQUIRE(res.has_value());
+
+  // the tree doesn't refer to the original string
+  std::fill(script.begin(), script.end(), 'X');
+  auto tree = std::move(*res);
+
+  const auto & root = tree.root();
+  CHECK(root.kind == kind::script);
+  REQUIRE(root.children().size() == 4u);
+  CHECK(root.children()[0].kind == kind::comment);
+
+  const auto & set = root.children()[1];
+  CHECK(set.kind == kind::command);
+  CHECK(set.text == "set x [expr {$a + 1}]");
+  REQUIRE(set.children().size() == 3u);
+  CHECK(set.children()[0].kind == kind::simple_word);
+  CHECK(set.children()[0].text == "set");
+
+  const auto & subst = set.children()[2].children()[0];
+  CHECK(subst.kind == kind::command_subst);
+  CHECK(subst.text == "[expr {$a + 1}]");
+  REQUIRE(subst.children().size() == 1u);
+  const auto & expr = subst.children()[0];
+  CHECK(expr.text == "expr {$a + 1}");
+  // the braced argument parses as a script too
+  CHECK(expr.children()[1].children()[0].kind == kind::braced);
+
+  const auto & puts = root.children()[2];
+  const auto & str = puts.children()[1];
+  CHECK(str.kind == kind::word);
+  REQUIRE(str.children().size() == 4u);
+  CHECK(str.children()[0].kind == kind::text);
+  const auto & var = str.children()[1];
+  CHECK(var.kind == kind::variable);
+  CHECK(var.text == "$arr(k\\n)");
+  REQUIRE(var.children().size() == 3u);
+  CHECK(var.children()[0].text == "arr");
+  CHECK(var.children()[2].kind == kind::backslash);
+  CHECK(str.children()[3].kind == kind::command_subst);
+
+  const auto & expand = root.children()[3];
+  CHECK(expand.children()[0].kind == kind::expand_word);
+  CHECK(expand.children()[1].children()[0].kind == kind::braced);
+  CHECK(expand.children()[1].children()[0].children()[0].text == "foo bar");
+  CHECK(expand.children()[2].children()[0].kind == kind::braced);
+
+  std::size_t count = 0u, depth = 0u;
+  tree.visit([&](const tcl::ast::node &, std::size_t d) {count++; depth = (std::max)(depth, d);});
+  CHECK(count == tree.size());
+  CHECK(depth >= 6u);
+}
+
+TEST_CASE("ast-braces")
+{
+  auto tree = tcl::parse_ast(interp, "set x {a [b}", false).value();
+  const auto & word = tree.root().children()[0].children()[2];
+  CHECK(word.children()[0].kind == kind::text);
+
+  // not a valid script, so it stays text
+  auto tree2 = tcl::parse_ast(interp, "set x {a [b}").value();
+  CHECK(tree2.root().children()[0].children()[2].children()[0].kind == kind::text);
+
+  // the commands before the error don't end up in the word
+  auto tree3 = tcl::parse_ast(interp, "set x {a b; [c}").value();
+  const auto & word3 = tree3.root().children()[0].children()[2];
+  REQUIRE(word3.children().size() == 1u);
+  CHECK(word3.children()[0].kind == kind::text);
+  CHECK(word3.children()[0].text == "a b; [c");
+
+  for (const auto * tr : {&tree, &tree2, &tree3})
+  {
+    std::size_t count = 0u;
+    tr->visit([&](const tcl::ast::node &, std::size_t) {count++;});
+    CHECK(count == tr->size());
+  }
+}
+
+TEST_CASE("ast-error")
+{
+  CHECK(tcl::parse_ast(interp, "set x [foo \"bar]").has_error());
+  CHECK(tcl::parse_ast(interp, "set x {foo").has_error());
+  CHECK(tcl::parse_ast(interp, "").value().root().children().empty());
+}
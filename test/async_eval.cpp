@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/async_eval.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+#include <metal/tcl/command.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "doctest.h"
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+// process events on the interpreter's thread until the future is ready
+template<typename T>
+tcl::result<T> wait(tcl::eval_future<T> & f)
+{
+  while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    Tcl_DoOneEvent(TCL_ALL_EVENTS);
+  return f.get();
+}
+
+}
+
+TEST_CASE("async-eval")
+{
+  tcl::interpreter_handle handle{interp};
+  CHECK(handle.thread_id() == Tcl_GetCurrentThread());
+
+  tcl::eval_future<int> f1, f2;
+  tcl::eval_future<std::string> f3;
+  tcl::eval_future<void> f4;
+  std::thread thr{
+      [&]
+      {
+        f1 = tcl::async_eval<int>(handle, "expr {6 * 7}");
+        f2 = tcl::async_eval<int>(handle, "expr {1 / 0}");
+        f3 = tcl::async_eval<std::string>(handle, "set async_var xyz");
+        f4 = tcl::async_eval<void>(handle, "unset async_var");
+      }};
+  thr.join();
+
+  CHECK(wait(f1).value() == 42);
+  auto r2 = wait(f2);
+  REQUIRE(r2.has_error());
+  CHECK(std::string(Tcl_GetString(r2.error().get())) == "divide by zero");
+  CHECK(wait(f3).value() == "xyz");
+  CHECK(wait(f4).has_value());
+}
+
+TEST_CASE("async-eval-exception")
+{
+  tcl::create_command(interp, "async_throw").add_function(
+      []() -> int
+      {
+        throw std::out_of_range("async out of range");
+      });
+
+  tcl::interpreter_handle handle{interp};
+  auto f = tcl::async_eval<int>(handle, "async_throw");
+  auto r = wait(f);
+  REQUIRE(r.has_error());
+  CHECK_THROWS_AS(std::rethrow_exception(tcl::cast<std::exception_ptr>(interp, r.error())), std::out_of_range);
+}
+
+TEST_CASE("async-eval-asio")
+{
+  boost::asio::io_context ctx;
+  tcl::interpreter_handle handle{interp};
+
+  std::atomic<int> value{0};
+  std::thread::id completed_on;
+  tcl::async_eval<int>(handle, "expr {1 + 2}",
+                       boost::asio::bind_executor(
+                           ctx,
+                           [&](tcl::result<int> res)
+                           {
+                             completed_on = std::this_thread::get_id();
+                             value = res.value();
+                           }));
+
+  // the pending eval keeps ctx.run from returning until the handler ran
+  std::thread runner{[&]{ctx.run();}};
+  const auto runner_id = runner.get_id();
+  while (value == 0)
+    Tcl_DoOneEvent(TCL_ALL_EVENTS | TCL_DONT_WAIT);
+  runner.join();
+  CHECK(value == 3);
+  CHECK(completed_on == runner_id);
+}
+
+TEST_CASE("async-eval-thread-exit")
+{
+  // the owner thread gets finalized with the job still queued
+  std::promise<tcl::interpreter_handle> handle_promise;
+  std::promise<void> submitted;
+  std::thread owner{
+      [&]
+      {
+        std::optional<tcl::interpreter_handle> handle;
+        {
+          auto ip = tcl::make_interpreter();
+          handle.emplace(ip);
+        }
+        handle_promise.set_value(*handle);
+        submitted.get_future().wait();
+        Tcl_FinalizeThread();
+      }};
+
+  auto handle = handle_promise.get_future().get();
+  auto f = tcl::async_eval<int>(handle, "expr {1 + 1}");
+  submitted.set_value();
+  owner.join();
+
+  REQUIRE(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+  auto r = f.get();
+  REQUIRE(r.has_error());
+  CHECK(std::string(Tcl_GetString(r.error().get())) == "interpreter deleted");
+
+  // & afterwards, they complete right away
+  auto f2 = tcl::async_eval<int>(handle, "expr {1 + 1}");
+  REQUIRE(f2.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+  CHECK(f2.get().has_error());
+}
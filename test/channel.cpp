@@ -7,7 +7,14 @@
 
 #include <metal/tcl/channel.hpp>
 #include <metal/tcl/eval.hpp>
+#include <metal/tcl/thread.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
 #include <filesystem>
+#include <fstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <boost/beast/core/flat_buffer.hpp>
 
@@ -98,4 +105,107 @@ TEST_CASE("channel")
   auto cd = ti.buffer.cdata();
   core::string_view dt{static_cast<const char *>(cd.data()), cd.size() - 1};
   CHECK(dt == "xyz123");
-}
\ No newline at end of file
+}
+
+TEST_CASE("mmap-channel")
+{
+  std::filesystem::path pt{__FILE__};
+  const auto path = (pt.parent_path() / "channel.tcl").string();
+
+  std::string expected;
+  {
+    std::ifstream ifs{path, std::ios::binary};
+    expected.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  }
+
+  CHECK(tcl::create_mmap_channel(interp, "/does/not/exist") == nullptr);
+  CHECK(tcl::create_mmap_channel(interp, "/dev/null") == nullptr);
+  CHECK(tcl::create_mmap_channel(interp, pt.parent_path().string().c_str()) == nullptr);
+  {
+    // a fifo without a writer would block on open, & with one on read
+    const auto fifo = (std::filesystem::temp_directory_path() / ("mmap-fifo-" + std::to_string(::getpid()))).string();
+    REQUIRE(::mkfifo(fifo.c_str(), 0600) == 0);
+    CHECK(tcl::create_mmap_channel(interp, fifo.c_str()) == nullptr);
+    CHECK_THROWS_AS(tcl::mmap_channel{fifo.c_str()}, boost::system::system_error);
+    std::filesystem::remove(fifo);
+  }
+
+  auto chan = tcl::create_mmap_channel(interp, path.c_str(), "mmaptest");
+  REQUIRE(chan != nullptr);
+  Tcl_RegisterChannel(interp, chan);
+
+  auto mc = tcl::get_mmap_channel(interp, "mmaptest");
+  REQUIRE(mc != nullptr);
+  CHECK(core::string_view(mc->data().data(), mc->data().size()) == expected);
+  CHECK(tcl::get_mmap_channel(interp, "stdout") == nullptr);
+
+  CHECK(tcl::eval<std::string>(interp, "fconfigure mmaptest -translation binary; read mmaptest").value() == expected);
+  CHECK(tcl::eval<bool>(interp, "eof mmaptest").value());
+  CHECK(tcl::eval<std::string>(interp, "seek mmaptest 6; read mmaptest 4").value() == expected.substr(6, 4));
+  CHECK(tcl::eval<std::string>(interp, "seek mmaptest -5 end; read mmaptest").value() == expected.substr(expected.size() - 5));
+  CHECK(tcl::eval<int>(interp, "seek mmaptest 2; seek mmaptest 3 current; tell mmaptest").value() == 5);
+  CHECK(tcl::eval(interp, "seek mmaptest -1 start").has_error());
+  CHECK(tcl::eval(interp, "puts mmaptest foo").has_error());
+
+  // always readable, like a file
+  CHECK(tcl::eval<int>(interp, R"(
+    seek mmaptest 0
+    set ::mmap_lines 0
+    fileevent mmaptest readable {
+      if {[gets mmaptest line] >= 0} {incr ::mmap_lines} else {fileevent mmaptest readable {}; set ::mmap_done 1}
+    }
+    vwait ::mmap_done
+    set ::mmap_lines)").value() == std::count(expected.begin(), expected.end(), '\n') + (expected.back() != '\n'));
+
+  tcl::eval(interp, "close mmaptest").value();
+}
+
+TEST_CASE("pipe-channel")
+{
+  // smaller than the data, so the writer has to wait for the reader
+  auto buf = tcl::make_pipe_buffer(4096u);
+  auto reader = tcl::create_pipe_reader(buf, "pipetest");
+  Tcl_RegisterChannel(interp, reader);
+
+  constexpr int lines = 10000;
+  tcl::thread producer{
+      [buf]
+      {
+        auto chan = tcl::create_pipe_writer(buf);
+        for (int i = 0; i < lines; i++)
+        {
+          const auto ln = "line " + std::to_string(i) + "\n";
+          Tcl_WriteChars(chan, ln.c_str(), static_cast<int>(ln.size()));
+        }
+        Tcl_Close(nullptr, chan);
+        Tcl_FinalizeThread();
+      }};
+
+  CHECK(tcl::eval<int>(interp, R"(
+    fconfigure pipetest -blocking 0
+    set ::pipe_lines 0
+    set ::pipe_ok 1
+    fileevent pipetest readable {
+      while {[gets pipetest line] >= 0} {
+        if {$line ne "line $::pipe_lines"} {set ::pipe_ok 0}
+        incr ::pipe_lines
+      }
+      if {[eof pipetest]} {fileevent pipetest readable {}; set ::pipe_done 1}
+    }
+    vwait ::pipe_done
+    set ::pipe_lines)").value() == lines);
+  CHECK(tcl::eval<bool>(interp, "set ::pipe_ok").value());
+  producer.join();
+  tcl::eval(interp, "close pipetest").value();
+
+  // the reader is gone
+  auto buf2 = tcl::make_pipe_buffer();
+  auto writer = tcl::create_pipe_writer(buf2, "pipetest2");
+  Tcl_RegisterChannel(interp, writer);
+  Tcl_Close(nullptr, tcl::create_pipe_reader(buf2));
+  CHECK(tcl::eval(interp, "puts pipetest2 foo; flush pipetest2").has_error());
+  tcl::eval(interp, "catch {close pipetest2}").value();
+
+  // closed ends don't leave an event source behind
+  CHECK(tcl::eval(interp, "update"));
+}
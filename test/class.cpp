@@ -94,4 +94,75 @@ TEST_CASE("cast")
   auto pp = pt.parent_path() / "class.tcl";
   metal::tcl::eval_file(interp, pp.string().c_str());
 }
+
+struct lazy_class
+{
+  int k;
+  lazy_class(int k) : k(k) {}
+  int get() { return k; }
+};
+
+BOOST_DESCRIBE_STRUCT(lazy_class, (), (k, get));
+METAL_TCL_DESCRIBE_CONSTRUCTORS(lazy_class, (int));
+METAL_TCL_SET_CLASS_NAME(lazy_class, lazy-class);
+
+TEST_CASE("registry")
+{
+  REQUIRE(Tcl_InitStubs(interp , TCL_VERSION ,0) != nullptr);
+  REQUIRE(Tcl_OOInitStubs(interp) != nullptr);
+
+  auto cl = metal::tcl::register_class<test_class>(interp);
+  CHECK(cl != nullptr);
+  CHECK(cl == metal::tcl::register_class<test_class>(interp));
+
+  // only a placeholder until first used
+  metal::tcl::declare_class<lazy_class>(interp);
+  CHECK(metal::tcl::eval<std::string>(interp, "info object isa class lazy-class").value() == "0");
+  CHECK(metal::tcl::eval<void>(interp, "set lc [lazy-class new 42]").has_value());
+  CHECK(metal::tcl::eval<std::string>(interp, "info object isa class lazy-class").value() == "1");
+
+  auto lc = metal::tcl::register_class<lazy_class>(interp);
+  CHECK(lc != nullptr);
+
+  auto both = metal::tcl::register_classes<test_class, lazy_class>(interp);
+  CHECK(both[0] == cl);
+  CHECK(both[1] == lc);
+}
+
+TEST_CASE("inheritance")
+{
+  REQUIRE(Tcl_InitStubs(interp , TCL_VERSION ,0) != nullptr);
+  REQUIRE(Tcl_OOInitStubs(interp) != nullptr);
+
+  metal::tcl::register_class<test_class>(interp);
+  auto base_name = metal::tcl::eval<std::string>(interp, "info class superclass test-class");
+  REQUIRE(base_name.has_value());
+
+  // base methods are only defined on the base class
+  CHECK(metal::tcl::eval<std::string>(interp, "info class methods test-class").value().find("test") == std::string::npos);
+  CHECK(metal::tcl::eval<std::string>(interp, "info class methods " + base_name.value()).value().find("test") != std::string::npos);
+
+  CHECK(metal::tcl::eval<int>(interp, "set tc [test-class new 42]; $tc test").value() == 12);
+
+  auto p = metal::tcl::make_object(interp, test_class{2});
+  auto tc = metal::tcl::try_cast<test_class>(interp, p.get());
+  REQUIRE(tc != nullptr);
+  CHECK(tc->j == 2);
+  CHECK(metal::tcl::try_cast<base>(interp, p.get()) == static_cast<base*>(tc));
+}
+
+TEST_CASE("static")
+{
+  REQUIRE(Tcl_InitStubs(interp , TCL_VERSION ,0) != nullptr);
+  REQUIRE(Tcl_OOInitStubs(interp) != nullptr);
+
+  metal::tcl::register_class<test_class>(interp);
+  test_class::static_i = 100;
+  CHECK(metal::tcl::eval<int>(interp, "test-class s_get").value() == 100);
+  CHECK(metal::tcl::eval<void>(interp, "test-class s_set 42").has_value());
+  CHECK(test_class::static_i == 42);
+  CHECK(metal::tcl::eval<int>(interp, "test-class s_get").value() == 42);
+  CHECK(metal::tcl::eval<int>(interp, "test-class s_get 1").has_error());
+  CHECK(metal::tcl::eval<void>(interp, "test-class s_set foo").has_error());
+}
 TEST_SUITE_END();
\ No newline at end of file
@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/direct.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+int direct_total = 0;
+std::string direct_name;
+
+}
+
+TEST_CASE("direct-script")
+{
+  tcl::create_command(interp, "direct-add").add_function(+[](int i) {return direct_total += i;});
+  tcl::create_command(interp, "direct-name").add_function(+[](std::string s) {direct_name = std::move(s);});
+  tcl::create_command(interp, "direct-fail").add_function(+[]() -> int {throw std::runtime_error("direct failure");});
+
+  tcl::direct_script ds{interp, "# a config\ndirect-add 1; direct-add {2}\n\n  direct-name \"some name\"\ndirect-add 3\n"};
+  CHECK(ds.direct());
+  CHECK(ds.evaluate<int>().value() == 6);
+  CHECK(direct_name == "some name");
+  CHECK(ds.evaluate<int>().value() == 12);
+
+  CHECK(!tcl::direct_script{interp, "direct-add [expr 1]"}.direct());
+  CHECK(!tcl::direct_script{interp, "direct-add $x"}.direct());
+  CHECK(!tcl::direct_script{interp, "direct-add {*}$x"}.direct());
+  CHECK(!tcl::direct_script{interp, "direct-add 1\nset x 1"}.direct());
+  CHECK(!tcl::direct_script{interp, "direct-add {1"}.direct());
+
+  // fallback works like eval
+  tcl::direct_script fb{interp, "set direct_x 4; direct-add $direct_x"};
+  CHECK(!fb.direct());
+  CHECK(fb.evaluate<int>().value() == 16);
+
+  tcl::direct_script err{interp, "direct-add 1\ndirect-fail\ndirect-add 100"};
+  REQUIRE(err.direct());
+  auto res = err.evaluate();
+  REQUIRE(!res);
+  CHECK(direct_total == 17);
+  tcl::object_ptr opts = Tcl_GetReturnOptions(interp, TCL_ERROR);
+  tcl::object_ptr key = Tcl_NewStringObj("-errorinfo", -1);
+  Tcl_Obj * info = nullptr;
+  REQUIRE(Tcl_DictObjGet(interp, opts.get(), key.get(), &info) == TCL_OK);
+  REQUIRE(info);
+  CHECK(std::string(Tcl_GetString(info)).find("\"direct-fail\"") != std::string::npos);
+
+  // a replaced command gets called through tcl
+  CHECK(tcl::eval(interp, "rename direct-add {}; proc direct-add {i} {return proc-$i}"));
+  CHECK(ds.evaluate<std::string>().value() == "proc-3");
+  CHECK(tcl::eval(interp, "rename direct-add {}"));
+}
+
+TEST_CASE("direct-script-eval")
+{
+  tcl::create_command(interp, "direct-inc").add_function(+[](int i) {return direct_total += i;});
+
+  // no commands, no result
+  tcl::direct_script empty{interp, "# nothing\n"};
+  REQUIRE(empty.direct());
+  CHECK(tcl::eval(interp, "set direct_y foo"));
+  CHECK(empty.evaluate<std::string>().value().empty());
+
+  // a command limit applies to direct calls too
+  tcl::direct_script ds{interp, "direct-inc 1; direct-inc 1; direct-inc 1; direct-inc 1"};
+  REQUIRE(ds.direct());
+  const int count = tcl::eval<int>(interp, "info cmdcount").value();
+  Tcl_LimitSetCommands(interp, count + 3);
+  Tcl_LimitTypeSet(interp, TCL_LIMIT_COMMANDS);
+  auto res = ds.evaluate();
+  Tcl_LimitTypeReset(interp, TCL_LIMIT_COMMANDS);
+  REQUIRE(res.has_error());
+  CHECK(tcl::cast<std::string>(interp, res.error()) == "command count limit exceeded");
+  CHECK(ds.evaluate().has_value());
+  CHECK(tcl::eval(interp, "rename direct-inc {}"));
+}
@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/builtin.hpp>
+#include "doctest.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+extern Tcl_Interp *interp;
+
+TEST_SUITE_BEGIN("eval");
+
+TEST_CASE("script-cache")
+{
+  namespace tcl = metal::tcl;
+  tcl::set_script_cache_capacity(interp, 2);
+  const auto initial = tcl::get_script_cache_stats(interp);
+  CHECK(initial.capacity == 2u);
+
+  CHECK(tcl::eval<int>(interp, "expr {1 + 2}").value() == 3);
+  CHECK(tcl::eval<int>(interp, "expr {1 + 2}").value() == 3);
+  CHECK(tcl::global_eval<int>(interp, std::string("expr {1 + 2}")).value() == 3);
+
+  auto st = tcl::get_script_cache_stats(interp);
+  CHECK(st.misses == initial.misses + 1);
+  CHECK(st.hits   == initial.hits   + 2);
+  CHECK(st.size   == 1u);
+
+  CHECK(tcl::eval<int>(interp, "expr {2 + 2}").value() == 4);
+  CHECK(tcl::eval<int>(interp, "expr {3 + 2}").value() == 5);
+  st = tcl::get_script_cache_stats(interp);
+  CHECK(st.size == 2u);
+
+  // evicted
+  CHECK(tcl::eval<int>(interp, "expr {1 + 2}").value() == 3);
+  CHECK(tcl::get_script_cache_stats(interp).misses == st.misses + 1);
+
+  // errors are still reported
+  CHECK(tcl::eval<int>(interp, "error foobar").has_error());
+  CHECK(tcl::eval<int>(interp, "error foobar").has_error());
+
+  tcl::set_script_cache_capacity(interp, 0);
+  CHECK(tcl::get_script_cache_stats(interp).size == 0u);
+  CHECK(tcl::eval<int>(interp, "expr {1 + 2}").value() == 3);
+  CHECK(tcl::get_script_cache_stats(interp).size == 0u);
+  tcl::set_script_cache_capacity(interp, 256);
+}
+
+TEST_CASE("mapped-file")
+{
+  namespace tcl = metal::tcl;
+  const auto pt = std::filesystem::temp_directory_path() / "metal_tcl_mapped_file.tcl";
+  const auto write =
+      [&](const char * content)
+      {
+        std::ofstream f{pt, std::ios::trunc};
+        f << content;
+      };
+
+  write("incr ::mapped_count\nset ::mapped_script [info script]\nexpr {6 * 7}");
+  CHECK(tcl::eval<void>(interp, "set ::mapped_count 0").has_value());
+
+  CHECK(tcl::eval_mapped_file<int>(interp, pt.string()).value() == 42);
+  CHECK(tcl::eval_mapped_file<int>(interp, pt.string()).value() == 42);
+  CHECK(tcl::eval_mapped_file<int>(interp, pt.string(), false).value() == 42);
+  CHECK(tcl::eval<int>(interp, "set ::mapped_count").value() == 3);
+  CHECK(tcl::eval<std::string>(interp, "set ::mapped_script").value() == pt.string());
+  CHECK(tcl::eval<std::string>(interp, "info script").value() != pt.string());
+
+  // picks up modifications
+  write("return foobar");
+  std::filesystem::last_write_time(pt, std::filesystem::last_write_time(pt) + std::chrono::seconds(2));
+  CHECK(tcl::eval_mapped_file<std::string>(interp, pt.string()).value() == "foobar");
+
+  write("error failed");
+  std::filesystem::last_write_time(pt, std::filesystem::last_write_time(pt) + std::chrono::seconds(4));
+  auto res = tcl::eval_mapped_file<void>(interp, pt.string());
+  REQUIRE(res.has_error());
+  CHECK(tcl::cast<std::string>(interp, res.error()) == "failed");
+
+  // like source, the top-level of the file is a level of its own, also when called from a proc
+  write("return -code error returned");
+  std::filesystem::last_write_time(pt, std::filesystem::last_write_time(pt) + std::chrono::seconds(6));
+  res = tcl::eval_mapped_file<void>(interp, pt.string());
+  REQUIRE(res.has_error());
+  CHECK(tcl::cast<std::string>(interp, res.error()) == "returned");
+  CHECK(tcl::eval<std::string>(interp, "set ::errorInfo").value().find("(file \"" + pt.string()) != std::string::npos);
+
+  Tcl_CreateObjCommand(interp, "mapped_source",
+                       [](ClientData, Tcl_Interp * ip, int, Tcl_Obj * const objv[])
+                       {
+                         return tcl::detail::eval_mapped_file(ip, Tcl_GetString(objv[1]), true);
+                       }, nullptr, nullptr);
+  CHECK(tcl::eval<std::string>(interp, "proc mapped_proc {path} {mapped_source $path; return after}; "
+                                       "list [catch {mapped_proc " + pt.string() + "} msg] $msg").value()
+        == "1 returned");
+  write("return -level 2 early");
+  std::filesystem::last_write_time(pt, std::filesystem::last_write_time(pt) + std::chrono::seconds(8));
+  CHECK(tcl::eval<std::string>(interp, "mapped_proc " + pt.string()).value() == "early");
+  tcl::eval(interp, "rename mapped_proc {}; rename mapped_source {}");
+
+  tcl::clear_file_cache(interp);
+  std::filesystem::remove(pt);
+  CHECK(tcl::eval_mapped_file<void>(interp, pt.string()).has_error());
+}
+
+TEST_SUITE_END();
@@ -5,6 +5,7 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
 #include <metal/tcl/expr.hpp>
+#include <metal/tcl/eval.hpp>
 #include <metal/tcl/builtin/integral.hpp>
 #include <metal/tcl/builtin/string.hpp>
 
@@ -20,4 +21,57 @@ TEST_CASE("expr")
   CHECK(tcl::expr<int>(interp, 42) == 42);
   CHECK(tcl::expr<int>(interp, "23 + 12") == 35);
   CHECK_THROWS(tcl::expr<int>(interp, "12 / 0").value());
-}
\ No newline at end of file
+}
+
+TEST_CASE("compiled-expr")
+{
+  tcl::compiled_expr plain{interp, "6 * 7"};
+  CHECK(plain.evaluate<int>() == 42);
+  CHECK(plain.evaluate<int>() == 42);
+
+  int x = 1;
+  tcl::compiled_expr ex{interp, "$x * $y + [string length $s]"};
+  ex.bind("x", x);
+  const auto y = ex.declare("y");
+  ex.set(y, 10);
+  ex.set("s", std::string("abc"));
+
+  CHECK(ex.evaluate<int>() == 13);
+  x = 2;
+  CHECK(ex.evaluate<int>() == 23);
+  ex.set(y, 100);
+  CHECK(ex.evaluate<int>() == 203);
+
+  // variables are local to the expression
+  CHECK(!Tcl_GetVar(interp, "y", 0));
+
+  ex.set("s", std::string("not a number"));
+  CHECK(ex.evaluate<int>() == 212);
+  ex.set(y, std::string("z"));
+  CHECK_THROWS(ex.evaluate<int>().value());
+}
+
+TEST_CASE("compiled-expr-scope")
+{
+  // other variables come from the caller, with & without declared ones
+  CHECK(tcl::eval(interp, "set ::expr_g 5; array set ::expr_a {k 7}"));
+  tcl::compiled_expr ex{interp, "$expr_g + $expr_a(k) + ${expr_g}"};
+  CHECK(ex.evaluate<int>() == 17);
+
+  int x = 1;
+  ex.bind("x", x);
+  CHECK(ex.evaluate<int>() == 17);
+
+  tcl::compiled_expr ex2{interp, "$expr_g * $x"};
+  ex2.bind("x", x);
+  CHECK(ex2.evaluate<int>() == 5);
+  CHECK(tcl::eval(interp, "set ::expr_g 6"));
+  CHECK(ex2.evaluate<int>() == 6);
+
+  tcl::compiled_expr missing{interp, "$expr_missing * $x"};
+  missing.bind("x", x);
+  auto res = missing.evaluate<int>();
+  REQUIRE(res.has_error());
+  CHECK(tcl::cast<std::string>(interp, res.error()) == "can't read \"expr_missing\": no such variable");
+  CHECK(tcl::eval(interp, "unset ::expr_g ::expr_a"));
+}
@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/fcopy.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+std::string read_file(const std::filesystem::path & pt)
+{
+  std::ifstream ifs{pt, std::ios::binary};
+  return {std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+}
+
+Tcl_Channel channel(const char * var)
+{
+  return Tcl_GetChannel(interp, tcl::eval<std::string>(interp, std::string("set ") + var).value().c_str(), nullptr);
+}
+
+}
+
+TEST_CASE("fcopy")
+{
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto src = dir / "metal_tcl_fcopy_src", dst = dir / "metal_tcl_fcopy_dst";
+
+  std::string content;
+  for (int i = 0; i < 100000; i++)
+    content += "line " + std::to_string(i) + "\r\n";
+  std::ofstream{src, std::ios::binary} << content;
+
+  Tcl_SetVar(interp, "fc_src", src.c_str(), TCL_GLOBAL_ONLY);
+  Tcl_SetVar(interp, "fc_dst", dst.c_str(), TCL_GLOBAL_ONLY);
+
+  SUBCASE("file to file")
+  {
+    tcl::eval(interp, "set ::fc_in [open $::fc_src rb]; set ::fc_out [open $::fc_dst wb]").value();
+    CHECK(tcl::kernel_copy_possible(channel("::fc_in"), channel("::fc_out")));
+
+    // some of it is buffered by tcl already
+    CHECK(tcl::eval<std::string>(interp, "gets $::fc_in").value() == "line 0\r");
+    auto res = tcl::copy_channel(interp, channel("::fc_in"), channel("::fc_out"));
+    REQUIRE(res.has_value());
+    CHECK(*res == static_cast<Tcl_WideInt>(content.size() - 8u));
+    tcl::eval(interp, "close $::fc_in; close $::fc_out").value();
+    CHECK(read_file(dst) == content.substr(8u));
+  }
+
+  SUBCASE("append")
+  {
+    std::ofstream{dst, std::ios::binary} << "head\n";
+    tcl::eval(interp, "set ::fc_in [open $::fc_src rb]; set ::fc_out [open $::fc_dst ab]").value();
+    CHECK(!tcl::kernel_copy_possible(channel("::fc_in"), channel("::fc_out")));
+    auto res = tcl::copy_channel(interp, channel("::fc_in"), channel("::fc_out"));
+    REQUIRE(res.has_value());
+    CHECK(*res == static_cast<Tcl_WideInt>(content.size()));
+    tcl::eval(interp, "close $::fc_in; close $::fc_out").value();
+    CHECK(read_file(dst) == "head\n" + content);
+  }
+
+  SUBCASE("through a pipe")
+  {
+    tcl::create_fcopy_command(interp);
+    // fits into the pipe's buffer
+    CHECK(tcl::eval<Tcl_WideInt>(interp, R"(
+      set ::fc_in [open $::fc_src rb]
+      lassign [chan pipe] ::fc_pr ::fc_pw
+      fconfigure $::fc_pr -translation binary
+      fconfigure $::fc_pw -translation binary
+      metal::fcopy $::fc_in $::fc_pw -size 20000)").value() == 20000);
+    CHECK(tcl::kernel_copy_possible(channel("::fc_pr"), channel("::fc_pw")));
+    CHECK(tcl::eval<Tcl_WideInt>(interp, R"(
+      close $::fc_pw
+      set ::fc_out [open $::fc_dst wb]
+      metal::fcopy $::fc_pr $::fc_out)").value() == 20000);
+    tcl::eval(interp, "close $::fc_in; close $::fc_out; close $::fc_pr").value();
+    CHECK(read_file(dst) == content.substr(0u, 20000u));
+    CHECK(tcl::eval(interp, "metal::fcopy stdin stdout -foo 2").has_error());
+  }
+
+  SUBCASE("fallback")
+  {
+    // translated & transformed channels go through tcl's buffers
+    tcl::eval(interp, "set ::fc_in [open $::fc_src r]; set ::fc_out [open $::fc_dst wb]; zlib push deflate $::fc_out").value();
+    CHECK(!tcl::kernel_copy_possible(channel("::fc_in"), channel("::fc_out")));
+    tcl::eval(interp, "fconfigure $::fc_in -translation binary").value();
+    CHECK(!tcl::kernel_copy_possible(channel("::fc_in"), channel("::fc_out")));
+    tcl::eval(interp, "fconfigure $::fc_in -translation crlf").value();
+
+    auto res = tcl::copy_channel(interp, channel("::fc_in"), channel("::fc_out"), 1000);
+    REQUIRE(res.has_value());
+    CHECK(*res == 1000);
+    tcl::eval(interp, "close $::fc_in; close $::fc_out").value();
+    CHECK(tcl::eval<std::string>(interp, "set f [open $::fc_dst rb]; zlib push inflate $f; set d [read $f]; close $f; set d").value()
+          == [&]{auto s = content; std::string r; for (auto c : s) if (c != '\r') r += c; return r.substr(0, 1000);}());
+  }
+
+  std::filesystem::remove(src);
+  std::filesystem::remove(dst);
+}
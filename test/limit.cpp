@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/limit.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "doctest.h"
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+TEST_CASE("limit-commands")
+{
+  tcl::eval_limits limits;
+  limits.commands = 1000;
+
+  tcl::eval_usage usage;
+  CHECK(tcl::eval<int>(interp, "set x 0; for {set i 0} {$i < 10} {incr i} {incr x}; set x", limits, &usage).value() == 10);
+  CHECK(!usage.commands_exceeded);
+  CHECK(usage.commands > 10);
+  CHECK(usage.commands < 100);
+
+  auto res = tcl::eval(interp, "while 1 {incr x}", limits, &usage);
+  REQUIRE(!res);
+  CHECK(std::string(Tcl_GetString(res.error().get())) == "command count limit exceeded");
+  CHECK(usage.commands_exceeded);
+  CHECK(usage.commands >= 1000);
+
+  // the interpreter is still usable, without limits
+  CHECK(tcl::eval<int>(interp, "set x 0; for {set i 0} {$i < 10000} {incr i} {incr x}; set x").value() == 10000);
+}
+
+TEST_CASE("limit-time")
+{
+  tcl::eval_limits limits;
+  limits.time = std::chrono::milliseconds(50);
+
+  tcl::eval_usage usage;
+  auto res = tcl::eval(interp, "while 1 {}", limits, &usage);
+  REQUIRE(!res);
+  CHECK(std::string(Tcl_GetString(res.error().get())) == "time limit exceeded");
+  CHECK(usage.time_exceeded);
+  CHECK(usage.time >= std::chrono::milliseconds(50));
+  CHECK(tcl::eval(interp, "set y 1"));
+}
+
+TEST_CASE("limit-memory")
+{
+  std::size_t memory = 0u;
+  tcl::eval_limits limits;
+  limits.memory = 100u;
+  limits.memory_probe = [&]{return memory += 10u;};
+  limits.memory_check_interval = 10;
+
+  tcl::eval_usage usage;
+  auto res = tcl::eval(interp, "while 1 {incr x}", limits, &usage);
+  REQUIRE(!res);
+  CHECK(std::string(Tcl_GetString(res.error().get())) == "memory limit exceeded");
+  CHECK(usage.memory_exceeded);
+  CHECK(!usage.commands_exceeded);
+  CHECK(usage.peak_memory == 110u);
+  CHECK(tcl::eval(interp, "set y 1"));
+}
+
+TEST_CASE("limit-cancel")
+{
+  tcl::eval_canceller canceller{interp};
+  CHECK(!canceller.cancel());
+
+  tcl::eval_limits limits;
+  limits.canceller = &canceller;
+
+  std::thread thr{
+      [&]
+      {
+        while (!canceller.cancel())
+          std::this_thread::yield();
+      }};
+
+  tcl::eval_usage usage;
+  // the cancel unwinds through catch
+  auto res = tcl::eval(interp, "while 1 {catch {while 1 {}}}", limits, &usage);
+  thr.join();
+  REQUIRE(!res);
+  CHECK(usage.canceled);
+  CHECK(tcl::eval<int>(interp, "expr {1 + 1}", limits, &usage).value() == 2);
+  CHECK(!usage.canceled);
+}
+
+TEST_CASE("limit-threads")
+{
+  // every thread has its own interpreter, so nothing may be shared between them
+  std::vector<std::thread> threads;
+  std::atomic<int> passed{0};
+  for (int t = 0; t < 4; t++)
+    threads.emplace_back(
+        [&]
+        {
+          {
+            auto ip = tcl::make_interpreter();
+            tcl::eval_limits limits;
+            limits.commands = 1000;
+            bool ok = true;
+            for (int i = 0; i < 100; i++)
+              ok = ok && tcl::eval<int>(ip, "expr {6 * 7}", limits).value() == 42;
+            if (ok)
+              passed++;
+          }
+          Tcl_FinalizeThread();
+        });
+  for (auto & t : threads)
+    t.join();
+  CHECK(passed == 4);
+}
@@ -0,0 +1,128 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/link.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/var.hpp>
+#include <metal/tcl/builtin/float.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <cstring>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+enum class link_mode {idle, running, stopped};
+constexpr const char * link_mode_names[] = {"idle", "running", "stopped"};
+
+std::optional<link_mode> tag_invoke(tcl::cast_tag<link_mode>, Tcl_Interp *, tcl::object_ptr obj)
+{
+  for (int i = 0; i < 3; i++)
+    if (std::strcmp(Tcl_GetString(obj.get()), link_mode_names[i]) == 0)
+      return static_cast<link_mode>(i);
+  return std::nullopt;
+}
+
+tcl::object_ptr tag_invoke(const tcl::convert_tag &, Tcl_Interp *, link_mode m)
+{
+  return Tcl_NewStringObj(link_mode_names[static_cast<int>(m)], -1);
+}
+
+}
+
+TEST_CASE("link-native")
+{
+  int i = 42;
+  double d = 1.5;
+  {
+    auto li = tcl::link(interp, "link_int", i);
+    auto ld = tcl::link(interp, "link_double", d, true);
+    static_assert(decltype(li)::native);
+
+    CHECK(tcl::eval<int>(interp, "set ::link_int").value() == 42);
+    i = 12;
+    CHECK(tcl::eval<int>(interp, "set ::link_int").value() == 12);
+    tcl::eval(interp, "set ::link_int 7");
+    CHECK(i == 7);
+    CHECK(tcl::eval(interp, "set ::link_int foo").has_error());
+    CHECK(i == 7);
+
+    CHECK(tcl::eval<double>(interp, "set ::link_double").value() == 1.5);
+    CHECK(tcl::eval(interp, "set ::link_double 2.0").has_error());
+    CHECK(d == 1.5);
+
+    tcl::eval(interp, "set ::link_seen {}; trace add variable ::link_int write {apply {args {lappend ::link_seen $::link_int}}}");
+    i = 3;
+    li.update();
+    CHECK(tcl::get<std::string>(interp, "link_seen") == "3");
+  }
+  // unlinked
+  tcl::eval(interp, "set ::link_int 99");
+  CHECK(i == 3);
+  tcl::unset(interp, "link_int");
+  tcl::unset(interp, "link_double");
+}
+
+TEST_CASE("link-traced")
+{
+  bool b = true;
+  std::string s = "foo";
+  std::atomic<int> a{5};
+  link_mode m = link_mode::running;
+  {
+    auto lb = tcl::link(interp, "link_bool", b);
+    auto ls = tcl::link(interp, "link_str", s);
+    auto la = tcl::link(interp, "link_atomic", a);
+    auto lm = tcl::link(interp, "link_mode", m, true);
+    static_assert(!decltype(lb)::native);
+    static_assert(!decltype(la)::native);
+
+    CHECK(tcl::eval<bool>(interp, "set ::link_bool").value());
+    tcl::eval(interp, "set ::link_bool no");
+    CHECK(!b);
+    CHECK(tcl::eval(interp, "set ::link_bool maybe").has_error());
+    CHECK(!b);
+    CHECK(!tcl::eval<bool>(interp, "set ::link_bool").value());
+
+    CHECK(tcl::eval<std::string>(interp, "set ::link_str").value() == "foo");
+    s = "bar";
+    CHECK(tcl::eval<std::string>(interp, "set ::link_str").value() == "bar");
+    tcl::eval(interp, "append ::link_str baz");
+    CHECK(s == "barbaz");
+
+    a = 6;
+    CHECK(tcl::eval<int>(interp, "incr ::link_atomic").value() == 7);
+    CHECK(a == 7);
+
+    CHECK(tcl::eval<std::string>(interp, "set ::link_mode").value() == "running");
+    m = link_mode::stopped;
+    CHECK(tcl::eval<std::string>(interp, "set ::link_mode").value() == "stopped");
+    CHECK(tcl::eval(interp, "set ::link_mode idle").has_error());
+    CHECK(m == link_mode::stopped);
+
+    // unsetting re-creates the variable
+    tcl::eval(interp, "unset ::link_str");
+    s = "again";
+    CHECK(tcl::eval<std::string>(interp, "set ::link_str").value() == "again");
+
+    tcl::eval(interp, "set ::link_seen {}; trace add variable ::link_atomic write {apply {args {lappend ::link_seen $::link_atomic}}}");
+    a = 1;
+    la.update();
+    la.update();
+    CHECK(tcl::get<std::string>(interp, "link_seen") == "1");
+  }
+  tcl::eval(interp, "set ::link_str unlinked");
+  CHECK(s == "again");
+  for (auto n : {"link_bool", "link_str", "link_atomic", "link_mode", "link_seen"})
+    tcl::unset(interp, n);
+}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/nr.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+#include <metal/tcl/eval.hpp>
+
+#include <stdexcept>
+
+#include "doctest.h"
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+TEST_CASE("nr-command")
+{
+  tcl::create_nr_command(interp, "nr_twice").add_function_with_interp(
+      +[](Tcl_Interp * ip, tcl::object_ptr script)
+      {
+        tcl::nr_eval(ip, script,
+                     [script](Tcl_Interp * ip, int code)
+                     {
+                       if (code != TCL_OK)
+                         return code;
+                       // the continuation runs after the first evaluation returned
+                       tcl::nr_eval(ip, script);
+                       return TCL_OK;
+                     });
+      });
+
+  CHECK(tcl::eval<int>(interp, "set nr_cnt 0; nr_twice {incr nr_cnt}; set nr_cnt").value() == 2);
+  CHECK(tcl::eval<int>(interp, "nr_twice {incr nr_cnt}").value() == 4);
+  CHECK(!tcl::eval(interp, "nr_twice {error foo}"));
+
+  // works with yield, which a regular command would reject
+  CHECK(tcl::eval<std::string>(interp,
+                               "list [coroutine nr_coro nr_twice {yield [incr nr_cnt]}] "
+                               "[nr_coro] [nr_coro] [info commands nr_coro]").value() == "5 6 {} {}");
+}
+
+#if defined(__cpp_impl_coroutine)
+
+namespace
+{
+
+tcl::nr_task<int> nr_sum(Tcl_Interp * ip, int n)
+{
+  int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += tcl::cast<int>(ip, (co_await tcl::nr_yield(i)).value());
+  co_return sum;
+}
+
+tcl::nr_task<int> nr_depth(Tcl_Interp * ip, int n)
+{
+  if (n == 0)
+    co_return 0;
+  // recurses through tcl & back without growing the C stack
+  auto res = co_await tcl::nr_eval(Tcl_ObjPrintf("nr_depth %d", n - 1));
+  co_return tcl::cast<int>(ip, res.value()) + 1;
+}
+
+tcl::nr_task<> nr_fail(Tcl_Interp * ip, tcl::object_ptr script)
+{
+  auto res = co_await tcl::nr_eval(script);
+  if (!res)
+    throw std::runtime_error("nr_fail: " + tcl::cast<std::string>(ip, res.error()));
+}
+
+}
+
+TEST_CASE("nr-task")
+{
+  tcl::create_nr_command(interp, "nr_sum").add_function_with_interp(&nr_sum);
+  tcl::create_nr_command(interp, "nr_depth").add_function_with_interp(&nr_depth);
+  tcl::create_nr_command(interp, "nr_fail").add_function_with_interp(&nr_fail);
+
+  CHECK(tcl::eval<int>(interp, "nr_sum 0").value() == 0);
+
+  CHECK(tcl::eval<std::string>(interp,
+                               "set r [coroutine nr_sum_coro nr_sum 3]; "
+                               "lappend r [nr_sum_coro 10] [nr_sum_coro 20] [nr_sum_coro 30]").value() == "0 1 2 60");
+
+  // deleting the suspended coroutine resumes the task with an error, which ends it
+  CHECK(tcl::eval(interp, "coroutine nr_sum_del nr_sum 3; rename nr_sum_del {}"));
+
+  CHECK(tcl::eval<int>(interp, "interp recursionlimit {} 100000; set r [nr_depth 50000]; interp recursionlimit {} 1000; set r").value() == 50000);
+
+  CHECK(tcl::eval(interp, "nr_fail {set x 1}"));
+  auto res = tcl::eval(interp, "nr_fail {error bar}");
+  REQUIRE(!res);
+  CHECK(std::string(Tcl_GetString(res.error().get())) == "nr_fail: bar");
+}
+
+#endif
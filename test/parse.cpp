@@ -139,3 +139,78 @@ TEST_CASE("parse-var")
   CHECK(pv->first == "$abcd");
   CHECK(pv->second == "42");
 }
+
+TEST_CASE("command-stream")
+{
+  tcl::command_stream cs{interp};
+  CHECK(!cs.next().value());
+
+  cs.append("set a 1; set b {2\n");
+  auto c = cs.next();
+  REQUIRE(c.has_value());
+  REQUIRE(c.value());
+  CHECK(*c.value() == "set a 1;");
+  CHECK(cs.parsed().numWords == 3);
+  CHECK(!cs.next().value());
+  CHECK(cs.pending() == " set b {2\n");
+
+  cs.append("3}\n# comment\nputs \"[string length \"x;\n\"]\"");
+  c = cs.next();
+  REQUIRE(c.value());
+  CHECK(*c.value() == "set b {2\n3}\n");
+  CHECK(!cs.next().value());
+
+  auto buf = cs.prepare(64);
+  constexpr char tail[] = "\nset c ${a}\n";
+  std::copy_n(tail, sizeof(tail) - 1, buf.data());
+  cs.commit(sizeof(tail) - 1);
+
+  c = cs.next();
+  REQUIRE(c.value());
+  CHECK(*c.value() == "puts \"[string length \"x;\n\"]\"\n");
+  c = cs.next();
+  REQUIRE(c.value());
+  CHECK(*c.value() == "set c ${a}\n");
+  CHECK(!cs.next().value());
+
+  // errors skip the command
+  cs.append("set x {a}b\nset y 2\n");
+  CHECK(cs.next().has_error());
+  c = cs.next();
+  REQUIRE(c.value());
+  CHECK(*c.value() == "set y 2\n");
+
+  cs.append("set z [list 1");
+  CHECK(!cs.next().value());
+  cs.finish();
+  CHECK(cs.next().has_error());
+
+  tcl::command_stream fin{interp};
+  fin.append("set last 1");
+  CHECK(!fin.next().value());
+  fin.finish();
+  c = fin.next();
+  REQUIRE(c.value());
+  CHECK(*c.value() == "set last 1");
+}
+
+TEST_CASE("command-stream-chunks")
+{
+  // feeding a script byte by byte yields the same commands as feeding it at once
+  const std::string script = "set a {x\n[y]}\nputs \"a;b\\\"\n\"; # c\\\nd\nset b [list [list 1 2]\n3]\nset c $a(x)\n";
+
+  std::vector<std::string> all, chunked;
+  tcl::command_stream cs1{interp}, cs2{interp};
+  cs1.append(script);
+  while (auto c = cs1.next().value())
+    all.emplace_back(*c);
+
+  for (auto ch : script)
+  {
+    cs2.append(boost::core::string_view(&ch, 1));
+    while (auto c = cs2.next().value())
+      chunked.emplace_back(*c);
+  }
+  CHECK(all.size() == 4u);
+  CHECK(all == chunked);
+}
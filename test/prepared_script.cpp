@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/prepared_script.hpp>
+#include <metal/tcl/builtin.hpp>
+#include <metal/tcl/eval.hpp>
+#include "doctest.h"
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+TEST_SUITE_BEGIN("prepared_script");
+
+TEST_CASE("invoke")
+{
+  tcl::prepared_script add{interp, {"x", "y"}, "expr {$x + $y}"};
+  CHECK(add.invoke<int>(1, 2).value() == 3);
+  CHECK(add.invoke<double>(1.5, 2).value() == 3.5);
+
+  // no quoting issues
+  tcl::prepared_script concat{interp, {"a", "b"}, "string cat $a $b"};
+  CHECK(concat.invoke<std::string>(std::string("{["), std::string("$x\"")).value() == "{[$x\"");
+
+  CHECK(add.invoke<int>(1).has_error());
+  CHECK(add.invoke<int>(std::string("foo"), 2).has_error());
+  CHECK(add(3, 4).has_value());
+
+  tcl::prepared_script set{interp, {"v"}, "set ::prepared_value $v"};
+  CHECK(set.invoke<void>(42).has_value());
+  CHECK(tcl::eval<int>(interp, "set ::prepared_value").value() == 42);
+}
+
+TEST_CASE("namespace")
+{
+  REQUIRE(tcl::eval<void>(interp, "namespace eval ::prep { variable value 12 }").has_value());
+  tcl::prepared_script get{interp, {}, "variable value; return $value", "::prep"};
+  CHECK(get.invoke<int>().value() == 12);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/shared.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+TEST_CASE("shared-store")
+{
+  tcl::shared_store store;
+  CHECK(!store.get("x"));
+  store.set("x", 42);
+  CHECK(store.get("x") == tcl::shared_value{42});
+  CHECK(store.get("x") == tcl::shared_value{"42"});
+  CHECK(store.incr("x", 3) == 45);
+
+  store.set("s", "12");
+  CHECK(store.incr("s") == 13);
+  store.set("s", "foo");
+  CHECK_THROWS(store.incr("s"));
+  CHECK(store.append("s", "bar") == "foobar");
+  CHECK(store.append("x", "!") == "45!");
+
+  CHECK(!store.compare_and_swap("s", "nope", "baz"));
+  CHECK(store.compare_and_swap("s", "foobar", "baz"));
+  CHECK(store.get("s")->to_string() == "baz");
+  CHECK(!store.compare_and_swap("missing", "", "baz"));
+
+  CHECK(store.size() == 2u);
+  CHECK(store.unset("s"));
+  CHECK(!store.unset("s"));
+  CHECK(store.keys() == std::vector<std::string>{"x"});
+
+  store.set("cas", 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++)
+    threads.emplace_back(
+        [&, t]
+        {
+          for (int i = 0; i < 10000; i++)
+          {
+            store.incr("counter");
+            store.incr("key" + std::to_string(i % 100));
+            // a spin on a compare & swap
+            while (true)
+            {
+              auto cur = *store.get("cas");
+              if (store.compare_and_swap("cas", cur, std::get<Tcl_WideInt>(cur.value) + 1))
+                break;
+            }
+          }
+        });
+  for (auto & t : threads)
+    t.join();
+
+  CHECK(store.get("counter") == tcl::shared_value{80000});
+  CHECK(store.get("key7") == tcl::shared_value{800});
+  CHECK(store.get("cas") == tcl::shared_value{80000});
+}
+
+TEST_CASE("shared-value-format")
+{
+  // the same as tcl, without using it
+  for (double d : {0., -0., 1., 100., 1e6, 0.1, 3.14159, 1e-4, 1e-5, 1.5e-7, 1e16, 1e17, 1.2345678901234568e20, 2.5e300, 5e-324,
+                   std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()})
+  {
+    tcl::object_ptr obj = Tcl_NewDoubleObj(d);
+    CHECK(tcl::shared_value{d}.to_string() == Tcl_GetString(obj.get()));
+  }
+  CHECK(tcl::shared_value{Tcl_WideInt{-42}}.to_string() == "-42");
+  CHECK(tcl::shared_value{2.} == tcl::shared_value{"2.0"});
+
+  // integers are parsed like incr does
+  tcl::shared_store store;
+  for (auto [str, value] : {std::pair{"+5", 6}, {" 7 ", 8}, {"0x10", 17}, {"-0x10", -15}, {"010", 9}, {"0o17", 16}, {"0b101", 6}})
+  {
+    store.set("i", str);
+    CHECK(store.incr("i") == value);
+    CHECK(tcl::eval<int>(interp, std::string("set shared_i {") + str + "}; incr shared_i").value() == value);
+  }
+  for (auto str : {"1_000", "08", "0x", "--1", "+-1", "1.0"})
+  {
+    store.set("i", str);
+    CHECK_THROWS_AS(store.incr("i"), std::invalid_argument);
+  }
+
+  store.set("i", (std::numeric_limits<Tcl_WideInt>::max)());
+  CHECK_THROWS_AS(store.incr("i"), std::overflow_error);
+  store.set("i", (std::numeric_limits<Tcl_WideInt>::min)());
+  CHECK_THROWS_AS(store.incr("i", -1), std::overflow_error);
+  CHECK(store.incr("i", 1) == (std::numeric_limits<Tcl_WideInt>::min)() + 1);
+  store.set("i", "9223372036854775808");
+  CHECK_THROWS_AS(store.incr("i"), std::overflow_error);
+  store.set("i", "-9223372036854775808");
+  CHECK(store.incr("i") == (std::numeric_limits<Tcl_WideInt>::min)() + 1);
+}
+
+TEST_CASE("shared-command")
+{
+  tcl::shared_store store;
+  tcl::create_shared_command(interp, "metal::shared_test", store);
+
+  CHECK(tcl::eval(interp, "metal::shared_test get foo").has_error());
+  CHECK(tcl::eval<std::string>(interp, "metal::shared_test get foo bar").value() == "bar");
+  CHECK(tcl::eval<int>(interp, "metal::shared_test set foo [expr {6 * 7}]").value() == 42);
+  CHECK(std::holds_alternative<Tcl_WideInt>(store.get("foo")->value));
+  CHECK(tcl::eval<int>(interp, "metal::shared_test incr foo").value() == 43);
+  CHECK(tcl::eval<int>(interp, "metal::shared_test incr foo -3").value() == 40);
+  CHECK(tcl::eval(interp, "metal::shared_test incr foo x").has_error());
+  CHECK(tcl::eval<std::string>(interp, "metal::shared_test append bar a; metal::shared_test append bar b").value() == "ab");
+  CHECK(tcl::eval<bool>(interp, "metal::shared_test cas bar ab cd").value());
+  CHECK(!tcl::eval<bool>(interp, "metal::shared_test cas bar ab cd").value());
+  CHECK(tcl::eval<int>(interp, "metal::shared_test size").value() == 2);
+  CHECK(tcl::eval<std::string>(interp, "metal::shared_test keys f*").value() == "foo");
+  CHECK(tcl::eval<bool>(interp, "metal::shared_test exists bar").value());
+  CHECK(tcl::eval<bool>(interp, "metal::shared_test unset bar").value());
+  CHECK(!tcl::eval<bool>(interp, "metal::shared_test exists bar").value());
+
+  tcl::eval(interp, "rename metal::shared_test {}");
+}
@@ -0,0 +1,115 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/socket_channel.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/var.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
+#include "doctest.h"
+
+#include <vector>
+
+#if !defined(_WIN32)
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+namespace asio = boost::asio;
+
+TEST_CASE("socket-channel-local")
+{
+  asio::io_context ctx;
+
+  // an echo server in tcl, serving many connections from one event loop
+  tcl::eval(interp, R"(
+    proc socket_echo {chan} {
+      if {[gets $chan line] >= 0} {
+        puts $chan "echo: $line"
+        flush $chan
+      } elseif {[eof $chan]} {
+        close $chan
+        incr ::socket_closed
+      }
+    }
+    set ::socket_closed 0
+  )").value();
+
+  constexpr int sessions = 100;
+  std::vector<asio::local::stream_protocol::socket> clients;
+  for (int i = 0; i < sessions; i++)
+  {
+    asio::local::stream_protocol::socket client{ctx}, server{ctx};
+    asio::local::connect_pair(client, server);
+    auto chan = tcl::create_socket_channel(std::move(server));
+    Tcl_RegisterChannel(interp, chan);
+    tcl::eval(interp, std::string("fileevent ") + Tcl_GetChannelName(chan) + " readable [list socket_echo " +
+                      Tcl_GetChannelName(chan) + "]").value();
+    clients.push_back(std::move(client));
+  }
+
+  for (int i = 0; i < sessions; i++)
+    asio::write(clients[i], asio::buffer("hello " + std::to_string(i) + "\n"));
+
+  for (int i = 0; i < sessions; i++)
+  {
+    asio::streambuf buf;
+    // the server only answers while tcl processes events
+    clients[i].non_blocking(true);
+    boost::system::error_code ec;
+    std::size_t n = 0u;
+    while ((n = asio::read_until(clients[i], buf, '\n', ec)) == 0u && ec == asio::error::would_block)
+      Tcl_DoOneEvent(TCL_ALL_EVENTS);
+    REQUIRE(!ec);
+    std::string line{asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + n};
+    CHECK(line == "echo: hello " + std::to_string(i) + "\r\n");
+  }
+
+  for (auto & c : clients)
+    c.close();
+  while (tcl::get<int>(interp, "socket_closed") < sessions)
+    Tcl_DoOneEvent(TCL_ALL_EVENTS);
+}
+
+TEST_CASE("socket-channel-tcp")
+{
+  asio::io_context ctx;
+  asio::ip::tcp::acceptor acc{ctx, asio::ip::tcp::endpoint{asio::ip::address_v4::loopback(), 0}};
+  asio::ip::tcp::socket client{ctx};
+  client.connect(acc.local_endpoint());
+
+  auto chan = tcl::create_socket_channel(acc.accept(), "tcp_test_chan");
+  Tcl_RegisterChannel(interp, chan);
+
+  CHECK(tcl::eval<std::string>(interp, "fconfigure tcp_test_chan -peername").value().rfind("127.0.0.1:", 0) == 0u);
+  CHECK(tcl::eval(interp, "fconfigure tcp_test_chan -foo").has_error());
+  CHECK(tcl::eval<std::string>(interp, "fconfigure tcp_test_chan -blocking").value() == "0");
+
+  // non-blocking read without data
+  CHECK(tcl::eval<std::string>(interp, "read tcp_test_chan").value().empty());
+  CHECK(!tcl::eval<bool>(interp, "eof tcp_test_chan").value());
+
+  asio::write(client, asio::buffer(std::string("ping\n")));
+  tcl::eval(interp, "fileevent tcp_test_chan readable {set ::tcp_line [gets tcp_test_chan]}; vwait ::tcp_line").value();
+  CHECK(tcl::get<std::string>(interp, "tcp_line") == "ping");
+
+  tcl::eval(interp, "puts -nonewline tcp_test_chan pong; close tcp_test_chan").value();
+  std::string buf(4, '\0');
+  asio::read(client, asio::buffer(buf));
+  CHECK(buf == "pong");
+}
+
+#endif
@@ -0,0 +1,158 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <metal/tcl/transform.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <string>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+// length prefixed frames, i.e. `<size>:<data>`
+struct framing
+{
+  std::string pending;
+  std::size_t frames = 0u;
+
+  void input(boost::span<const char> raw, std::string & out)
+  {
+    pending.append(raw.data(), raw.size());
+    std::size_t pos = 0u;
+    for (;;)
+    {
+      const auto colon = pending.find(':', pos);
+      if (colon == std::string::npos)
+        break;
+      const auto size = std::stoul(pending.substr(pos, colon - pos));
+      if (pending.size() < colon + 1u + size)
+        break;
+      out.append(pending, colon + 1u, size);
+      pos = colon + 1u + size;
+      frames++;
+    }
+    pending.erase(0u, pos);
+  }
+
+  void output(boost::span<const char> data, std::string & out)
+  {
+    out += std::to_string(data.size());
+    out += ':';
+    out.append(data.data(), data.size());
+  }
+
+  void finish_output(std::string & out)
+  {
+    out += "0:";
+  }
+};
+
+METAL_TCL_SET_CLASS_NAME(framing, framing);
+
+TEST_CASE("transform")
+{
+  // every flush is one frame
+  tcl::eval(interp, "lassign [chan pipe] ::tr_in ::tr_out; fconfigure $::tr_out -buffering full").value();
+  auto in  = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_in").value().c_str(), nullptr);
+  auto out = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_out").value().c_str(), nullptr);
+
+  REQUIRE(tcl::create_transform<framing>(interp, out) != nullptr);
+  CHECK(tcl::get_transform<framing>(out) != nullptr);
+  CHECK(tcl::get_transform<framing>(in) == nullptr);
+
+  CHECK(tcl::eval<std::string>(interp, "puts -nonewline $::tr_out hello; flush $::tr_out; read $::tr_in 7").value() == "5:hello");
+
+  auto tin = tcl::create_transform<framing>(interp, in);
+  REQUIRE(tin != nullptr);
+  auto & framer = tcl::get_transform<framing>(tin)->impl();
+
+  CHECK(tcl::eval<std::string>(interp, "puts $::tr_out {hello world}; flush $::tr_out; gets $::tr_in").value() == "hello world");
+
+  // fileevents fire for data that's already decoded too
+  CHECK(tcl::eval<int>(interp, R"(
+    fconfigure $::tr_in -blocking 0
+    set ::tr_lines 0
+    fileevent $::tr_in readable {
+      while {[gets $::tr_in line] >= 0} {incr ::tr_lines}
+      if {$::tr_lines == 3} {fileevent $::tr_in readable {}; set ::tr_done 1}
+    }
+    puts $::tr_out "a\nb"
+    flush $::tr_out
+    after 10 {puts $::tr_out c; flush $::tr_out}
+    vwait ::tr_done
+    set ::tr_lines)").value() == 3);
+  CHECK(framer.frames == 3u);
+
+  // unstacking writes the final frame
+  tcl::eval(interp, "chan pop $::tr_out").value();
+  CHECK(tcl::eval<std::string>(interp, "fconfigure $::tr_in -blocking 1; chan pop $::tr_in; read $::tr_in 2").value() == "0:");
+
+  tcl::eval(interp, "close $::tr_out; close $::tr_in").value();
+}
+
+TEST_CASE("transform-stacked")
+{
+  tcl::eval(interp, "lassign [chan pipe] ::tr_in ::tr_out; fconfigure $::tr_out -buffering full").value();
+  auto out = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_out").value().c_str(), nullptr);
+
+  // the second one goes through the first one, even though out is the bottom channel
+  REQUIRE(tcl::create_transform<framing>(interp, out) != nullptr);
+  REQUIRE(tcl::create_transform<framing>(interp, out) != nullptr);
+  CHECK(tcl::eval<std::string>(interp, "puts -nonewline $::tr_out hi; flush $::tr_out; read $::tr_in 6").value() == "4:2:hi");
+
+  tcl::eval(interp, "chan pop $::tr_out; chan pop $::tr_out; close $::tr_out; close $::tr_in").value();
+}
+
+TEST_CASE("transform-nonblocking")
+{
+  tcl::eval(interp, "lassign [chan pipe] ::tr_in ::tr_out").value();
+  auto in  = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_in").value().c_str(), nullptr);
+  auto out = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_out").value().c_str(), nullptr);
+  REQUIRE(tcl::create_transform<framing>(interp, out) != nullptr);
+  REQUIRE(tcl::create_transform<framing>(interp, in) != nullptr);
+
+  // more than the os pipe holds, so the writes to it come up short.
+  // data that got lost or encoded twice would break the framing.
+  CHECK(tcl::eval<int>(interp, R"(
+    fconfigure $::tr_out -blocking 0 -buffering full
+    fconfigure $::tr_in -blocking 0
+    set chunk [string repeat x 3000]
+    for {set i 0} {$i < 100} {incr i} {puts -nonewline $::tr_out $chunk; flush $::tr_out}
+    set ::tr_read 0
+    set ::tr_ok 1
+    fileevent $::tr_in readable {
+      set data [read $::tr_in]
+      if {[string trim $data x] ne ""} {set ::tr_ok 0}
+      incr ::tr_read [string length $data]
+      if {$::tr_read >= 300000} {fileevent $::tr_in readable {}; set ::tr_done 1}
+    }
+    set timeout [after 5000 {set ::tr_done 0}]
+    vwait ::tr_done
+    after cancel $timeout
+    set ::tr_read)").value() == 300000);
+  CHECK(tcl::eval<bool>(interp, "set ::tr_ok").value());
+
+  tcl::eval(interp, "close $::tr_out; close $::tr_in").value();
+}
+
+TEST_CASE("transform-mode")
+{
+  struct decode_only
+  {
+    void input(boost::span<const char> raw, std::string & out) {out.append(raw.data(), raw.size());}
+  };
+
+  tcl::eval(interp, "lassign [chan pipe] ::tr_in ::tr_out").value();
+  auto out = Tcl_GetChannel(interp, tcl::eval<std::string>(interp, "set ::tr_out").value().c_str(), nullptr);
+  // the pipe isn't readable
+  CHECK(tcl::create_transform<decode_only>(interp, out) == nullptr);
+  tcl::eval(interp, "close $::tr_out; close $::tr_in").value();
+}
@@ -8,10 +8,15 @@
 #include <metal/tcl/var.hpp>
 #include <metal/tcl/eval.hpp>
 #include <metal/tcl/builtin/integral.hpp>
+#include <metal/tcl/builtin/string.hpp>
 #include <boost/asio.hpp>
 
 #include "doctest.h"
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
 using namespace boost;
 
 extern Tcl_Interp *interp;
@@ -74,3 +79,156 @@ TEST_CASE("var-trace")
   CHECK(called == true);
 
 }
+
+TEST_CASE("var-ref")
+{
+  tcl::var_ref<int> ref{interp, "var_ref_test"};
+  CHECK(!ref.try_get());
+  CHECK_THROWS(ref.get());
+
+  ref = 42;
+  CHECK(ref.get() == 42);
+  CHECK(tcl::get<int>(interp, "var_ref_test") == 42);
+
+  // unshared values are updated in place
+  auto obj = Tcl_GetVar2Ex(interp, "var_ref_test", nullptr, TCL_GLOBAL_ONLY);
+  ref = 43;
+  CHECK(Tcl_GetVar2Ex(interp, "var_ref_test", nullptr, TCL_GLOBAL_ONLY) == obj);
+  CHECK(tcl::get<int>(interp, "var_ref_test") == 43);
+
+  // writes from tcl invalidate the cache
+  tcl::eval(interp, "incr ::var_ref_test 2");
+  CHECK(ref.get() == 45);
+  tcl::eval(interp, "set ::var_ref_test 7");
+  CHECK(ref.get() == 7);
+
+  // other traces see our writes
+  tcl::eval(interp, "set ::var_ref_seen {}; trace add variable ::var_ref_test write {apply {args {lappend ::var_ref_seen $::var_ref_test}}}");
+  ref = 8;
+  ref = 9;
+  CHECK(tcl::get<std::string>(interp, "var_ref_seen") == "8 9");
+
+  // unset & re-created
+  tcl::eval(interp, "unset ::var_ref_test");
+  CHECK(!ref.try_get());
+  tcl::eval(interp, "set ::var_ref_test 12");
+  CHECK(ref.get() == 12);
+  tcl::eval(interp, "set ::var_ref_test 13");
+  CHECK(ref.get() == 13);
+
+  CHECK(ref.unset());
+  ref = 14;
+  CHECK(tcl::get<int>(interp, "var_ref_test") == 14);
+
+  tcl::var_ref<std::string> elem{interp, "var_ref_arr", "key"};
+  elem = "foo";
+  CHECK(tcl::get<std::string>(interp, "var_ref_arr", "key") == "foo");
+  tcl::eval(interp, "array unset ::var_ref_arr");
+  CHECK(!elem.try_get());
+  elem = "bar";
+  CHECK(elem.get() == "bar");
+  tcl::unset(interp, "var_ref_test");
+  tcl::unset(interp, "var_ref_arr");
+}
+
+TEST_CASE("batch-tracer")
+{
+  std::vector<std::vector<std::string>> calls;
+  auto record = [&](Tcl_Interp *, const char * name, boost::span<const std::string> keys)
+      {
+        CHECK(std::string(name) == "batch_arr");
+        std::vector<std::string> ks{keys.begin(), keys.end()};
+        std::sort(ks.begin(), ks.end());
+        calls.push_back(std::move(ks));
+      };
+
+  {
+    tcl::batch_tracer tr{record, interp, "batch_arr", tcl::batch_mode::manual};
+    tcl::eval(interp, "for {set i 0} {$i < 1000} {incr i} {set ::batch_arr([expr {$i % 3}]) $i}");
+    CHECK(calls.empty());
+    CHECK(tr.pending());
+    tr.flush();
+    REQUIRE(calls.size() == 1u);
+    CHECK(calls[0] == std::vector<std::string>{"0", "1", "2"});
+    tr.flush();
+    CHECK(calls.size() == 1u);
+
+    // unsetting the whole array reports the variable, and the tracer keeps watching
+    tcl::eval(interp, "set ::batch_arr(x) 1; unset ::batch_arr");
+    tr.flush();
+    REQUIRE(calls.size() == 2u);
+    CHECK(calls[1].empty());
+    tcl::eval(interp, "set ::batch_arr(y) 1");
+    tr.flush();
+    REQUIRE(calls.size() == 3u);
+    CHECK(calls[2] == std::vector<std::string>{"y"});
+  }
+  calls.clear();
+
+  {
+    tcl::batch_tracer tr{record, interp, "batch_arr", tcl::batch_mode::idle};
+    tcl::eval(interp, "set ::batch_arr(a) 1; set ::batch_arr(b) 2; set ::batch_arr(a) 3");
+    CHECK(calls.empty());
+    while (Tcl_DoOneEvent(TCL_IDLE_EVENTS | TCL_DONT_WAIT)) {}
+    REQUIRE(calls.size() == 1u);
+    CHECK(calls[0] == std::vector<std::string>{"a", "b"});
+  }
+  calls.clear();
+
+  {
+    tcl::batch_tracer tr{record, interp, "batch_arr", tcl::batch_mode::event};
+    tcl::eval(interp, "set ::batch_arr(c) 1; set ::batch_arr(c) 2");
+    CHECK(calls.empty());
+    while (Tcl_DoOneEvent(TCL_ALL_EVENTS | TCL_DONT_WAIT)) {}
+    REQUIRE(calls.size() == 1u);
+    CHECK(calls[0] == std::vector<std::string>{"c"});
+
+    // the pending event gets removed with the tracer
+    tcl::eval(interp, "set ::batch_arr(d) 1");
+  }
+  while (Tcl_DoOneEvent(TCL_ALL_EVENTS | TCL_DONT_WAIT)) {}
+  CHECK(calls.size() == 1u);
+
+  {
+    // exceptions don't unwind through the event loop, but become background errors
+    tcl::batch_tracer tr{[](Tcl_Interp *, const char *, boost::span<const std::string>)
+                         {
+                           throw std::runtime_error("batch failed");
+                         }, interp, "batch_arr", tcl::batch_mode::idle};
+    tcl::eval(interp, "proc batch_bgerror {msg opts} {set ::batch_error $msg}; interp bgerror {} batch_bgerror").value();
+    tcl::eval(interp, "set ::batch_arr(e) 1");
+    while (Tcl_DoOneEvent(TCL_ALL_EVENTS | TCL_DONT_WAIT)) {}
+    CHECK(tcl::eval<std::string>(interp, "set ::batch_error").value() == "batch failed");
+    tcl::eval(interp, "interp bgerror {} bgerror; rename batch_bgerror {}").value();
+  }
+  tcl::unset(interp, "batch_arr");
+}
+
+TEST_CASE("var-bulk")
+{
+  std::unordered_map<std::string, int> in;
+  for (int i = 0; i < 1000; i++)
+    in.emplace("k" + std::to_string(i), i);
+
+  tcl::set_array(interp, "bulk_arr", in);
+  CHECK(tcl::eval<int>(interp, "array size ::bulk_arr").value() == 1000);
+  CHECK(tcl::get<int>(interp, "bulk_arr", "k42") == 42);
+
+  auto out = tcl::get_array<std::map<std::string, int>>(interp, "bulk_arr");
+  CHECK(out.size() == 1000u);
+  CHECK(out["k999"] == 999);
+
+  // like `array get`, a missing array has no elements
+  CHECK(tcl::get_array<std::map<std::string, int>>(interp, "bulk_missing").empty());
+  tcl::set(interp, "bulk_scalar", 1);
+  CHECK_THROWS(tcl::set_array(interp, "bulk_scalar", in));
+
+  tcl::eval(interp, "namespace eval ::bulk_ns {}");
+  tcl::set_many(interp, "::bulk_ns", std::map<std::string, int>{{"x", 1}, {"y", 2}});
+  CHECK(tcl::eval<int>(interp, "expr {$::bulk_ns::x + $::bulk_ns::y}").value() == 3);
+  CHECK_THROWS(tcl::set_many(interp, "::bulk_nope", in));
+
+  tcl::eval(interp, "namespace delete ::bulk_ns");
+  tcl::unset(interp, "bulk_arr");
+  tcl::unset(interp, "bulk_scalar");
+}
@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2023 Klemens Morgenstern (klemens.morgenstern@gmx.net)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include <metal/tcl/vector_expr.hpp>
+#include <metal/tcl/eval.hpp>
+#include <metal/tcl/builtin/float.hpp>
+#include <metal/tcl/builtin/string.hpp>
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <cmath>
+
+extern Tcl_Interp *interp;
+namespace tcl = metal::tcl;
+
+namespace
+{
+
+// evaluates every row through expr, to compare against.
+std::vector<double> reference(const char * expression, const std::vector<double> & a, const std::vector<double> & b)
+{
+  std::vector<double> res;
+  tcl::compiled_expr ex{interp, expression};
+  for (std::size_t i = 0u; i < a.size(); i++)
+  {
+    ex.set("a", a[i]);
+    ex.set("b", b[i]);
+    res.push_back(ex.evaluate<double>().value());
+  }
+  return res;
+}
+
+}
+
+TEST_CASE("vector-expr")
+{
+  std::vector<double> a, b;
+  for (int i = 0; i < 1000; i++)
+  {
+    a.push_back(i * 0.5 - 100.);
+    b.push_back(std::sin(i) * 50.);
+  }
+
+  for (auto e : {"$a * $b + 1", "($a + 2.5) * -$b / 4", "$a < $b ? $a : $b ** 2",
+                 "sqrt(abs($a)) + hypot($a, $b) - min($a, $b, 5/2)", "!$a || $b >= 3 && $a != 0",
+                 "round($a / 3.0) + floor($b) + pow(2, 10)", "$a + [string length abc]", "fmod($a, 7)"})
+  {
+    CAPTURE(e);
+    tcl::vector_expr ex{interp, e, {"a", "b"}};
+    std::vector<double> out;
+    REQUIRE_NOTHROW(ex.evaluate({a, b}, out).value());
+    CHECK(out == reference(e, a, b));
+  }
+
+  CHECK(tcl::vector_expr{interp, "$a * $b", {"a", "b"}}.native());
+  CHECK(tcl::vector_expr{interp, "$a + 5 / 2", {"a"}}.native());
+  CHECK(!tcl::vector_expr{interp, "$a + [string length abc]", {"a"}}.native());
+  CHECK(!tcl::vector_expr{interp, "$a % 2", {"a"}}.native());
+  CHECK(!tcl::vector_expr{interp, "$a + $c", {"a"}}.native());
+
+  // only pure sub-expressions get folded, e.g. not rand() or procs in tcl::mathfunc
+  CHECK(tcl::vector_expr{interp, "$a * (2 ** 3 + int(1.5))", {"a"}}.native());
+  tcl::vector_expr rnd{interp, "$a + rand()", {"a"}};
+  CHECK(!rnd.native());
+  const std::vector<double> zeros(64u, 0.);
+  std::vector<double> out;
+  REQUIRE(rnd.evaluate({zeros}, out));
+  CHECK(std::count(out.begin(), out.end(), out.front()) < 64);
+
+  tcl::eval(interp, "set ::vector_calls 0; proc tcl::mathfunc::vector_counter {} {incr ::vector_calls}").value();
+  tcl::vector_expr counter{interp, "$a + vector_counter()", {"a"}};
+  CHECK(!counter.native());
+  REQUIRE(counter.evaluate({zeros}, out));
+  CHECK(out.back() == 64.);
+  tcl::eval(interp, "rename tcl::mathfunc::vector_counter {}").value();
+}
+
+TEST_CASE("vector-expr-errors")
+{
+  const std::vector<double> a{4., 1., -1., 9.};
+  std::vector<double> out(a.size());
+
+  tcl::vector_expr ex{interp, "sqrt($a)", {"a"}};
+  REQUIRE(ex.native());
+  auto res = ex.evaluate({a}, out);
+  REQUIRE(res.has_error());
+  CHECK(tcl::cast<std::string>(interp, res.error()) == "domain error: argument not in valid range");
+
+  // integer semantics of constant sub-expressions are preserved
+  tcl::vector_expr half{interp, "$a * (1 / 2)", {"a"}};
+  REQUIRE(half.evaluate({a}, out));
+  CHECK(out == std::vector<double>(a.size(), 0.));
+
+  tcl::vector_expr inf{interp, "$a / 0", {"a"}};
+  REQUIRE(inf.evaluate({a}, out));
+  CHECK(std::isinf(out[0]));
+}